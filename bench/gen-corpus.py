@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+Synthetic bilingual corpus generator.
+
+Writes, into --out-dir:
+
+    mono-s.txt, mono-t.txt   monolingual corpora for the `_s` and `_t` tags
+    par-s.txt,  par-t.txt    line-aligned parallel corpus
+    sup.txt                  labeled (`__label__k`) supervised data, `_s` side
+    empty.txt                empty file for modes that need no `-input`
+
+Word frequencies follow a Zipf law with exponent --zipf. Every word carries a
+language suffix (`_s` / `_t`) because `Model::getNegative` only samples
+negatives that share the last character of the target. The parallel side is
+a noisy word-by-word translation (same rank, other tag) so that the bilingual
+task has signal to learn, and supervised lines draw part of their words from
+a label-specific band of the vocabulary.
+
+    python3 bench/gen-corpus.py --out-dir /tmp/bil --tokens 2000000
+"""
+
+import argparse
+import itertools
+import os
+import random
+
+
+def zipf_cum_weights(vocab, s):
+    return list(itertools.accumulate(1.0 / (r + 1) ** s for r in range(vocab)))
+
+
+def sample_lines(rng, cum, nlines, line_len):
+    ranks = range(len(cum))
+    for _ in range(nlines):
+        n = max(1, int(rng.gauss(line_len, line_len / 4)))
+        yield rng.choices(ranks, cum_weights=cum, k=n)
+
+
+def fmt(ranks, tag):
+    return ' '.join('w%d_%s' % (r, tag) for r in ranks)
+
+
+def write_mono(path, rng, cum, tokens, line_len, tag):
+    with open(path, 'w') as f:
+        for ranks in sample_lines(rng, cum, max(1, tokens // line_len), line_len):
+            f.write(fmt(ranks, tag) + '\n')
+
+
+def write_par(path_s, path_t, rng, cum, nlines, line_len, noise):
+    vocab = len(cum)
+    with open(path_s, 'w') as fs, open(path_t, 'w') as ft:
+        for ranks in sample_lines(rng, cum, nlines, line_len):
+            trans = [r if rng.random() >= noise else rng.randrange(vocab) for r in ranks]
+            rng.shuffle(trans)
+            fs.write(fmt(ranks, 's') + '\n')
+            ft.write(fmt(trans, 't') + '\n')
+
+
+def write_sup(path, rng, cum, nlines, line_len, nlabels):
+    vocab = len(cum)
+    band = max(1, vocab // (2 * nlabels))
+    with open(path, 'w') as f:
+        for ranks in sample_lines(rng, cum, nlines, line_len):
+            label = rng.randrange(nlabels)
+            lo = vocab // 2 + label * band
+            topical = [lo + rng.randrange(band) for _ in range(max(1, len(ranks) // 3))]
+            words = [r for r in ranks + topical if r < vocab]
+            f.write('__label__%d %s\n' % (label, fmt(words, 's')))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('--out-dir', required=True)
+    p.add_argument('--vocab', type=int, default=50000, help='distinct words per language')
+    p.add_argument('--tokens', type=int, default=1000000, help='tokens per mono corpus')
+    p.add_argument('--par-lines', type=int, default=20000)
+    p.add_argument('--sup-lines', type=int, default=20000)
+    p.add_argument('--labels', type=int, default=4)
+    p.add_argument('--line-len', type=int, default=20)
+    p.add_argument('--zipf', type=float, default=1.0)
+    p.add_argument('--noise', type=float, default=0.1, help='parallel mistranslation rate')
+    p.add_argument('--seed', type=int, default=1)
+    a = p.parse_args()
+
+    os.makedirs(a.out_dir, exist_ok=True)
+    rng = random.Random(a.seed)
+    cum = zipf_cum_weights(a.vocab, a.zipf)
+    path = lambda name: os.path.join(a.out_dir, name)
+
+    write_mono(path('mono-s.txt'), rng, cum, a.tokens, a.line_len, 's')
+    write_mono(path('mono-t.txt'), rng, cum, a.tokens, a.line_len, 't')
+    write_par(path('par-s.txt'), path('par-t.txt'), rng, cum, a.par_lines, a.line_len, a.noise)
+    write_sup(path('sup.txt'), rng, cum, a.sup_lines, a.line_len, a.labels)
+    open(path('empty.txt'), 'w').close()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,692 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Microbenchmarks for the training and tokenization kernels.
+//
+// Every benchmark is calibrated to run for at least -min-time seconds and is
+// repeated -repeat times; the median is reported. Results are written to
+// stdout as a single JSON document so that two builds can be compared with
+// any JSON-aware diff tool.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../fasttext/alloc.h"
+#include "../fasttext/args.h"
+#include "../fasttext/dictionary.h"
+#include "../fasttext/input.h"
+#include "../fasttext/matrix.h"
+#include "../fasttext/model.h"
+#include "../fasttext/real.h"
+#include "../fasttext/utils.h"
+#include "../fasttext/vector.h"
+
+// --------
+// Allocation accounting
+
+static std::atomic<int64_t> g_alloc_bytes{0};
+static std::atomic<int64_t> g_alloc_count{0};
+
+// Every replaceable form of new and delete goes through these two, so that
+// arrays and sized deletes are counted and freed like the rest. They are
+// kept out of line: once inlined into a caller, GCC pairs the free() of a
+// delete with the operator new call and reports a mismatch.
+__attribute__((noinline)) static void* countedAlloc(size_t size) {
+  g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) static void countedFree(void* p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  return countedAlloc(size);
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+  return countedAlloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  countedFree(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+  countedFree(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  countedFree(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept {
+  countedFree(p);
+}
+
+// --------
+// Harness
+
+struct BenchParam {
+  std::string key;
+  int64_t value;
+};
+
+struct BenchResult {
+  std::string name;
+  std::vector<BenchParam> params;
+  int64_t iterations;
+  double ns_per_op;
+  double bytes_per_op;
+  double allocs_per_op;
+};
+
+// Largest error of an approximation against the libm function, in double
+// precision, over a grid of [lo, hi].
+struct AccuracyResult {
+  std::string name;
+  double lo;
+  double hi;
+  double max_abs;
+  double max_rel;
+};
+
+struct BenchConfig {
+  double min_time = 0.2;
+  int32_t repeat = 5;
+  std::string filter;
+};
+
+static BenchConfig g_config;
+static std::vector<BenchResult> g_results;
+static std::vector<AccuracyResult> g_accuracy;
+static volatile real g_sink;
+
+typedef std::function<void(int64_t)> BenchBody;
+
+double timeRun(const BenchBody& body, int64_t iters) {
+  auto t0 = std::chrono::steady_clock::now();
+  body(iters);
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+void runBench(const std::string& name, const std::vector<BenchParam>& params,
+              const BenchBody& body) {
+  std::string label = name;
+  for (auto& p : params) {
+    label += "/" + p.key + ":" + std::to_string(p.value);
+  }
+  if (!g_config.filter.empty() && label.find(g_config.filter) == std::string::npos) {
+    return;
+  }
+  std::cerr << "running " << label << std::flush;
+
+  // Calibrate: grow the iteration count until one run takes min_time.
+  int64_t iters = 1;
+  double elapsed = timeRun(body, iters);
+  while (elapsed < g_config.min_time && iters < (int64_t(1) << 40)) {
+    double scale = elapsed > 0 ? 1.4 * g_config.min_time / elapsed : 100.0;
+    scale = std::min(std::max(scale, 2.0), 100.0);
+    iters = int64_t(iters * scale);
+    elapsed = timeRun(body, iters);
+  }
+
+  std::vector<double> samples;
+  int64_t bytes = 0, allocs = 0;
+  for (int32_t r = 0; r < g_config.repeat; r++) {
+    int64_t b0 = g_alloc_bytes.load(), a0 = g_alloc_count.load();
+    samples.push_back(timeRun(body, iters) * 1e9 / iters);
+    bytes += g_alloc_bytes.load() - b0;
+    allocs += g_alloc_count.load() - a0;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  BenchResult res;
+  res.name = name;
+  res.params = params;
+  res.iterations = iters;
+  res.ns_per_op = samples[samples.size() / 2];
+  res.bytes_per_op = double(bytes) / (double(iters) * g_config.repeat);
+  res.allocs_per_op = double(allocs) / (double(iters) * g_config.repeat);
+  g_results.push_back(res);
+  std::cerr << "  " << res.ns_per_op << " ns/op" << std::endl;
+}
+
+void printJson(std::ostream& out) {
+  out << "{\n  \"context\": {\"min_time\": " << g_config.min_time
+      << ", \"repeat\": " << g_config.repeat
+      << ", \"sizeof_real\": " << sizeof(real) << "},\n";
+  out << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < g_results.size(); i++) {
+    const BenchResult& r = g_results[i];
+    out << "    {\"name\": \"" << r.name << "\", \"params\": {";
+    for (size_t j = 0; j < r.params.size(); j++) {
+      if (j > 0) out << ", ";
+      out << "\"" << r.params[j].key << "\": " << r.params[j].value;
+    }
+    out << "}, \"iterations\": " << r.iterations
+        << ", \"ns_per_op\": " << r.ns_per_op
+        << ", \"bytes_per_op\": " << r.bytes_per_op
+        << ", \"allocs_per_op\": " << r.allocs_per_op << "}";
+    out << (i + 1 < g_results.size() ? ",\n" : "\n");
+  }
+  out << "  ],\n  \"accuracy\": [\n";
+  for (size_t i = 0; i < g_accuracy.size(); i++) {
+    const AccuracyResult& a = g_accuracy[i];
+    out << "    {\"name\": \"" << a.name << "\", \"lo\": " << a.lo << ", \"hi\": " << a.hi
+        << ", \"max_abs\": " << a.max_abs << ", \"max_rel\": " << a.max_rel << "}";
+    out << (i + 1 < g_accuracy.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}" << std::endl;
+}
+
+void measureAccuracy(const std::string& name, double lo, double hi,
+                     const std::function<void(const real*, real*, int64_t)>& approx,
+                     const std::function<double(double)>& exact) {
+  if (!g_config.filter.empty() && name.find(g_config.filter) == std::string::npos) {
+    return;
+  }
+  const int64_t n = 1 << 20;
+  std::vector<real> x(n), y(n);
+  for (int64_t i = 0; i < n; i++) {
+    x[i] = lo + (hi - lo) * double(i) / (n - 1);
+  }
+  approx(x.data(), y.data(), n);
+  AccuracyResult res{name, lo, hi, 0.0, 0.0};
+  for (int64_t i = 0; i < n; i++) {
+    double e = exact(x[i]);
+    double err = std::abs(double(y[i]) - e);
+    res.max_abs = std::max(res.max_abs, err);
+    if (e != 0.0) res.max_rel = std::max(res.max_rel, err / std::abs(e));
+  }
+  g_accuracy.push_back(res);
+}
+
+// --------
+// Fixtures
+
+// Writes a corpus with `nwords` distinct words whose frequencies follow a
+// Zipf law. Words alternate between the `_s` and `_t` language tags so that
+// `Model::getNegative` exercises its language mask.
+std::string writeCorpus(int32_t nwords, int64_t ntokens, bool labels) {
+  char path[] = "/tmp/ft-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    std::cerr << "Cannot create temporary corpus file." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  std::ofstream ofs(path);
+  std::vector<double> cdf(nwords);
+  double z = 0.0;
+  for (int32_t i = 0; i < nwords; i++) {
+    z += 1.0 / (i + 1);
+    cdf[i] = z;
+  }
+  std::minstd_rand rng(1);
+  std::uniform_real_distribution<> uniform(0, z);
+  // Every word appears at least once so the vocabulary size is exact.
+  for (int32_t i = 0; i < nwords; i++) {
+    if (labels && i % 20 == 0) ofs << "__label__" << (i / 20) % 4 << " ";
+    ofs << "w" << i << (i % 2 ? "_t" : "_s") << (i % 20 == 19 ? "\n" : " ");
+  }
+  ofs << "\n";
+  for (int64_t i = nwords; i < ntokens; i++) {
+    if (labels && i % 20 == 0) ofs << "__label__" << (i / 20) % 4 << " ";
+    int32_t w = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+    w = std::min(w, nwords - 1);
+    ofs << "w" << w << (w % 2 ? "_t" : "_s") << (i % 20 == 19 ? "\n" : " ");
+  }
+  ofs.close();
+  return std::string(path);
+}
+
+struct Fixture {
+  std::shared_ptr<Args> args;
+  std::shared_ptr<Dictionary> dict;
+  std::string corpus;
+
+  Fixture(int32_t nwords, int32_t dim, int32_t minn, int32_t maxn, bool labels) {
+    args = std::make_shared<Args>();
+    args->dim = dim;
+    args->minn = minn;
+    args->maxn = maxn;
+    args->bucket = maxn > 0 ? 2000000 : 0;
+    args->verbose = 0;
+    corpus = writeCorpus(nwords, int64_t(nwords) * 10, labels);
+    args->input = corpus;
+    dict = std::make_shared<Dictionary>(args);
+  }
+
+  ~Fixture() {
+    unlink(corpus.c_str());
+  }
+};
+
+// --------
+// The 512-entry lookup tables the kernels in utils replaced, kept here as
+// the baseline for benchMath.
+
+namespace tables {
+  const int32_t SIGMOID_TABLE_SIZE = 512;
+  const int32_t MAX_SIGMOID = 8;
+  const int32_t LOG_TABLE_SIZE = 512;
+  real t_sigmoid[SIGMOID_TABLE_SIZE + 1];
+  real t_log[LOG_TABLE_SIZE + 1];
+
+  void init() {
+    for (int i = 0; i < SIGMOID_TABLE_SIZE + 1; i++) {
+      real x = real(i * 2 * MAX_SIGMOID) / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
+      t_sigmoid[i] = 1.0 / (1.0 + std::exp(-x));
+    }
+    for (int i = 0; i < LOG_TABLE_SIZE + 1; i++) {
+      real x = (real(i) + 1e-5) / LOG_TABLE_SIZE;
+      t_log[i] = std::log(x);
+    }
+  }
+
+  real sigmoid(real x) {
+    if (x < -MAX_SIGMOID) {
+      return 0.0;
+    } else if (x > MAX_SIGMOID) {
+      return 1.0;
+    } else {
+      int i = int((x + MAX_SIGMOID) * SIGMOID_TABLE_SIZE / MAX_SIGMOID / 2);
+      return t_sigmoid[i];
+    }
+  }
+
+  real log(real x) {
+    if (x > 1.0) {
+      return 0.0;
+    }
+    int i = int(x * LOG_TABLE_SIZE);
+    return t_log[i];
+  }
+}
+
+// --------
+// Benchmarks
+
+void benchMath() {
+  tables::init();
+  auto sigmoid = [](double x) { return 1.0 / (1.0 + std::exp(-x)); };
+  auto log = [](double x) { return std::log(x); };
+  auto exp = [](double x) { return std::exp(x); };
+  measureAccuracy("table sigmoid", -10, 10, [](const real* x, real* y, int64_t n) {
+    for (int64_t i = 0; i < n; i++) y[i] = tables::sigmoid(x[i]);
+  }, sigmoid);
+  measureAccuracy("utils::sigmoid_n", -10, 10, utils::sigmoid_n, sigmoid);
+  measureAccuracy("table log", 1e-3, 1, [](const real* x, real* y, int64_t n) {
+    for (int64_t i = 0; i < n; i++) y[i] = tables::log(x[i]);
+  }, log);
+  measureAccuracy("utils::log_n", 1e-3, 1, utils::log_n, log);
+  measureAccuracy("utils::log_n", 1e-3, 1e6, utils::log_n, log);
+  measureAccuracy("utils::exp_n", -80, 80, utils::exp_n, exp);
+
+  const int32_t n = 4096;
+  std::vector<real> x(n), y(n);
+  std::minstd_rand rng(5);
+  std::uniform_real_distribution<real> scores(-10, 10), probs(0, 1);
+  for (auto& v : x) v = scores(rng);
+  runBench("table sigmoid", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) {
+      for (int32_t i = 0; i < n; i++) y[i] = tables::sigmoid(x[i]);
+    }
+    g_sink = y[0];
+  });
+  runBench("utils::sigmoid_n", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) utils::sigmoid_n(x.data(), y.data(), n);
+    g_sink = y[0];
+  });
+  runBench("utils::exp_n", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) utils::exp_n(x.data(), y.data(), n);
+    g_sink = y[0];
+  });
+  runBench("std::exp", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) {
+      for (int32_t i = 0; i < n; i++) y[i] = std::exp(x[i]);
+    }
+    g_sink = y[0];
+  });
+  for (auto& v : x) v = probs(rng);
+  runBench("table log", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) {
+      for (int32_t i = 0; i < n; i++) y[i] = tables::log(x[i]);
+    }
+    g_sink = y[0];
+  });
+  runBench("utils::log_n", {{"n", n}}, [&](int64_t iters) {
+    for (int64_t k = 0; k < iters; k++) utils::log_n(x.data(), y.data(), n);
+    g_sink = y[0];
+  });
+}
+
+void benchMatrix() {
+  for (int32_t dim : {10, 100, 300}) {
+    // ~64MB per matrix so that random rows miss the last-level cache.
+    int64_t rows = (int64_t(1) << 24) / dim;
+    Matrix m(rows, dim);
+    m.uniform(1.0 / dim);
+    Vector v(dim);
+    v.zero();
+    v.addRow(m, 0);
+    std::vector<int64_t> idx(4096);
+    std::minstd_rand rng(2);
+    std::uniform_int_distribution<int64_t> pick(0, rows - 1);
+    for (auto& i : idx) i = pick(rng);
+    // Share of the matrix on huge pages, which depends on the host's THP
+    // settings and free memory.
+    alloc::HugePages huge = alloc::hugePages();
+    int64_t hugePct = huge.requested > 0 ? 100 * huge.backed / huge.requested : 0;
+
+    runBench("Matrix::dotRow", {{"dim", dim}, {"rows", rows}, {"hugePct", hugePct}}, [&](int64_t n) {
+      real acc = 0.0;
+      for (int64_t k = 0; k < n; k++) {
+        acc += m.dotRow(v, idx[k & 4095]);
+      }
+      g_sink = acc;
+    });
+    runBench("Matrix::addRow", {{"dim", dim}, {"rows", rows}, {"hugePct", hugePct}}, [&](int64_t n) {
+      for (int64_t k = 0; k < n; k++) {
+        m.addRow(v, idx[k & 4095], 1e-6);
+      }
+    });
+  }
+}
+
+void benchVector() {
+  for (int32_t dim : {10, 100, 300}) {
+    Vector v(dim);
+    v.zero();
+    runBench("Vector::mul(real)", {{"dim", dim}}, [&](int64_t n) {
+      for (int64_t k = 0; k < n; k++) {
+        v.mul(0.999);
+      }
+      g_sink = v[0];
+    });
+    for (int32_t osz : {16, 1000, 100000}) {
+      Matrix m(osz, dim);
+      m.uniform(1.0 / dim);
+      Vector hidden(dim), out(osz);
+      hidden.zero();
+      hidden.addRow(m, 0);
+      runBench("Vector::mul(Matrix)", {{"dim", dim}, {"osz", osz}}, [&](int64_t n) {
+        for (int64_t k = 0; k < n; k++) {
+          out.mul(m, hidden);
+        }
+        g_sink = out[0];
+      });
+    }
+  }
+}
+
+void benchModel() {
+  for (int32_t nwords : {1000, 100000}) {
+    for (int32_t dim : {10, 100, 300}) {
+      Fixture fx(nwords, dim, 0, 0, false);
+      int32_t vsz = fx.dict->nwords();
+      std::shared_ptr<Matrix> input = std::make_shared<Matrix>(vsz, dim);
+      std::shared_ptr<Matrix> output = std::make_shared<Matrix>(vsz, dim);
+      input->uniform(1.0 / dim);
+      output->uniform(1.0 / dim);
+      std::vector<int32_t> ctx = {1, 2, 3};
+      std::vector<int32_t> targets(4096);
+      std::minstd_rand rng(3);
+      std::uniform_int_distribution<int32_t> pick(0, vsz - 1);
+      // `</s>` has no other word sharing its language tag, so it can never
+      // be a target: `getNegative` would spin forever looking for one.
+      int32_t eos = fx.dict->getId(Dictionary::EOS);
+      for (auto& t : targets) {
+        do { t = pick(rng); } while (t == eos);
+      }
+
+      fx.args->loss = loss_name::ns;
+      Model ns(input, output, fx.args, 0);
+      ns.setTargetCounts(fx.dict->getCounts(entry_type::word), fx.dict);
+      ns.computeHidden(ctx);
+      runBench("Model::negativeSampling", {{"dim", dim}, {"nwords", vsz}, {"neg", fx.args->neg}},
+               [&](int64_t n) {
+        real loss = 0.0;
+        for (int64_t k = 0; k < n; k++) {
+          loss += ns.negativeSampling(targets[k & 4095], 1e-6);
+        }
+        g_sink = loss;
+      });
+      // Skipgram-shaped stream: four consecutive pairs share a center.
+      for (int32_t batch : {0, 64}) {
+        fx.args->batch = batch;
+        Model mb(input, output, fx.args, 0);
+        mb.setTargetCounts(fx.dict->getCounts(entry_type::word), fx.dict);
+        runBench("Model::update", {{"dim", dim}, {"nwords", vsz}, {"batch", batch}}, [&](int64_t n) {
+          for (int64_t k = 0; k < n; k++) {
+            const int32_t* center = &targets[(k >> 2) & 4095];
+            mb.update(id_range(center, center + 1), targets[k & 4095], 1e-6);
+          }
+          mb.flush();
+          g_sink = mb.getLoss();
+        });
+      }
+      fx.args->batch = 0;
+      runBench("Model::getNegative", {{"nwords", vsz}}, [&](int64_t n) {
+        int64_t acc = 0;
+        for (int64_t k = 0; k < n; k++) {
+          acc += ns.getNegative(targets[k & 4095]);
+        }
+        g_sink = acc;
+      });
+
+      fx.args->loss = loss_name::hs;
+      Model hs(input, output, fx.args, 0);
+      hs.setTargetCounts(fx.dict->getCounts(entry_type::word), fx.dict);
+      hs.computeHidden(ctx);
+      runBench("Model::hierarchicalSoftmax", {{"dim", dim}, {"nwords", vsz}}, [&](int64_t n) {
+        real loss = 0.0;
+        for (int64_t k = 0; k < n; k++) {
+          loss += hs.hierarchicalSoftmax(targets[k & 4095], 1e-6);
+        }
+        g_sink = loss;
+      });
+
+      // A full softmax over 100k outputs is not a configuration anyone
+      // trains; keep it to the label-sized case.
+      if (nwords <= 1000) {
+        fx.args->loss = loss_name::softmax;
+        Model sm(input, output, fx.args, 0);
+        sm.computeHidden(ctx);
+        runBench("Model::softmax", {{"dim", dim}, {"nwords", vsz}}, [&](int64_t n) {
+          real loss = 0.0;
+          for (int64_t k = 0; k < n; k++) {
+            loss += sm.softmax(targets[k & 4095], 1e-6);
+          }
+          g_sink = loss;
+        });
+      }
+      fx.args->loss = loss_name::ns;
+    }
+  }
+}
+
+// Model::update on a skipgram-shaped stream over matrices a few times the
+// size of the last-level cache, with the rows of the update `prefetch`
+// steps ahead requested the way FastText::skipgram does it. A center has
+// `ngrams` input rows: its word, then subwords drawn from a million buckets.
+void benchPrefetch() {
+  const int32_t nwords = 100000;
+  const int64_t npairs = 1 << 20;
+  for (auto config : {std::make_pair(300, 1), std::make_pair(100, 10)}) {
+    const int32_t dim = config.first, ngrams = config.second;
+    const int32_t bucket = ngrams > 1 ? 1000000 : 0;
+    Fixture fx(nwords, dim, 0, 0, false);
+    int32_t vsz = fx.dict->nwords();
+    std::shared_ptr<Matrix> input = std::make_shared<Matrix>(vsz + bucket, dim);
+    std::shared_ptr<Matrix> output = std::make_shared<Matrix>(vsz, dim);
+    input->uniform(1.0 / dim);
+    output->uniform(1.0 / dim);
+    std::minstd_rand rng(4);
+    std::uniform_int_distribution<int32_t> pickWord(0, vsz - 1);
+    std::uniform_int_distribution<int32_t> pickBucket(vsz, vsz + std::max(bucket, 1) - 1);
+    int32_t eos = fx.dict->getId(Dictionary::EOS);
+    std::vector<int32_t> targets(npairs);
+    for (auto& t : targets) {
+      do { t = pickWord(rng); } while (t == eos);
+    }
+    std::vector<int32_t> centers(npairs / 4 * ngrams);
+    for (int64_t c = 0; c < npairs / 4; c++) {
+      centers[c * ngrams] = pickWord(rng);
+      for (int32_t j = 1; j < ngrams; j++) {
+        centers[c * ngrams + j] = pickBucket(rng);
+      }
+    }
+    auto center = [&](int64_t c) {
+      return id_range(&centers[c * ngrams], &centers[(c + 1) * ngrams]);
+    };
+
+    fx.args->loss = loss_name::ns;
+    Model model(input, output, fx.args, 0);
+    model.setTargetCounts(fx.dict->getCounts(entry_type::word), fx.dict);
+    for (int32_t ahead : {0, 1, 2, 4}) {
+      runBench("Model::update prefetch",
+               {{"dim", dim}, {"nwords", vsz}, {"ngrams", ngrams}, {"prefetch", ahead}},
+               [&](int64_t n) {
+        for (int64_t k = 0; k < n; k++) {
+          int64_t i = k & (npairs - 1);
+          int64_t next = (i + ahead) & (npairs - 1);
+          if (ahead > 0) {
+            if ((next & 3) == 0) {
+              model.prefetchInput(center(next >> 2));
+            }
+            model.prefetchOutput(targets[next], ahead);
+          }
+          model.update(center(i >> 2), targets[i], 1e-6);
+        }
+        g_sink = model.getLoss();
+      });
+    }
+  }
+}
+
+void benchDictionary() {
+  for (int32_t nwords : {1000, 100000}) {
+    Fixture fx(nwords, 10, 3, 6, true);
+    std::ifstream ifs(fx.corpus);
+    std::stringstream buffer;
+    buffer << ifs.rdbuf();
+    const std::string text = buffer.str();
+    int64_t nlines = std::count(text.begin(), text.end(), '\n');
+
+    // The streams are built once so that copying the corpus into them does
+    // not show up in bytes/op.
+    std::istringstream in(text);
+    std::string word;
+    runBench("Dictionary::readWord", {{"nwords", nwords}}, [&](int64_t n) {
+      for (int64_t k = 0; k < n; k++) {
+        if (!fx.dict->readWord(in, word)) {
+          in.clear();
+          in.seekg(0);
+        }
+      }
+    });
+
+    std::vector<int32_t> line, labels;
+    std::minstd_rand rng(4);
+    in.clear();
+    in.seekg(0);
+    runBench("Dictionary::getLine", {{"nwords", nwords}, {"nlines", nlines}}, [&](int64_t n) {
+      for (int64_t k = 0; k < n; k++) {
+        fx.dict->getLine(in, line, labels, model_name::sg, rng);
+      }
+    });
+
+    // The same lines read from disk, as text and gzip compressed.
+    std::string gz = fx.corpus + ".gz";
+    gzFile out = gzopen(gz.c_str(), "wb");
+    gzwrite(out, text.data(), text.size());
+    gzclose(out);
+    for (const std::string& path : {fx.corpus, gz}) {
+      InputStream file(path);
+      runBench("InputStream::getLine", {{"nwords", nwords}, {"gzip", path == gz}}, [&](int64_t n) {
+        for (int64_t k = 0; k < n; k++) {
+          fx.dict->getLine(file, line, labels, model_name::sg, rng);
+        }
+      });
+    }
+    unlink(gz.c_str());
+
+    std::vector<std::string> words;
+    for (int32_t i = 0; i < std::min(fx.dict->nwords(), 4096); i++) {
+      words.push_back(Dictionary::BOW + fx.dict->getWord(i) + Dictionary::EOW);
+    }
+    std::vector<int32_t> ngrams;
+    ngrams.reserve(256);
+    runBench("Dictionary::computeNgrams", {{"nwords", nwords}, {"minn", 3}, {"maxn", 6}},
+             [&](int64_t n) {
+      for (int64_t k = 0; k < n; k++) {
+        ngrams.clear();
+        fx.dict->computeNgrams(words[k % words.size()], ngrams);
+      }
+    });
+  }
+}
+
+void printBenchUsage() {
+  std::cerr
+    << "usage: ft-bench [-filter <substr>] [-min-time <sec>] [-repeat <n>]\n\n"
+    << "  -filter     only run benchmarks whose label contains <substr>\n"
+    << "  -min-time   minimal duration of one measurement [" << g_config.min_time << "]\n"
+    << "  -repeat     number of measurements per benchmark [" << g_config.repeat << "]\n"
+    << std::endl;
+}
+
+int main(int argc, char** argv) {
+  for (int ai = 1; ai < argc; ai += 2) {
+    if (ai + 1 >= argc) {
+      printBenchUsage();
+      exit(EXIT_FAILURE);
+    }
+    if (strcmp(argv[ai], "-filter") == 0) {
+      g_config.filter = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-min-time") == 0) {
+      g_config.min_time = atof(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-repeat") == 0) {
+      g_config.repeat = atoi(argv[ai + 1]);
+    } else {
+      printBenchUsage();
+      exit(EXIT_FAILURE);
+    }
+  }
+  benchMath();
+  benchMatrix();
+  benchVector();
+  benchModel();
+  benchPrefetch();
+  benchDictionary();
+  printJson(std::cout);
+  return 0;
+}
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+End-to-end thread-scaling harness.
+
+Runs `ft bilingual-um`, `bilingual-umt` and `bilingual-s` on a corpus written
+by gen-corpus.py, over a grid of thread counts and dims, and reports for
+each run:
+
+    wall        wall-clock seconds
+    tok/s/core  trained tokens per second per busy core
+    rss_mb      peak resident set size of the training process
+    loss        mean of the last reported loss of every task
+
+Only `bilingual-umt` is multi-threaded; the other modes are run with one
+thread. Note that every `bilingual-umt` thread trains the full schedule, so
+the number of trained tokens grows with -thread and a flat tok/s/core line
+is perfect scaling.
+
+    python3 bench/gen-corpus.py --out-dir /tmp/bil
+    python3 bench/scaling.py --data /tmp/bil --threads 1,2,4,8 --dims 10,100
+
+--hot-rows adds a -hotRows axis (0 is the plain shared-matrix path), to
+compare per-thread caching of the frequent output rows at high thread
+counts:
+
+    python3 bench/scaling.py --data /tmp/bil --modes bilingual-umt \
+        --threads 8,16,32 --dims 100 --hot-rows 0,256,4096
+
+--replicas does the same for -replicas (0 is the single shared model); add
+-numa after -- to bind each replica's threads to its own node. The loss
+column then compares the averaged replicas against the single-replica run:
+
+    python3 bench/scaling.py --data /tmp/bil --modes bilingual-umt \
+        --threads 16,32 --dims 100 --replicas 0,2 -- -numa
+"""
+
+import argparse
+import itertools
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def mode_args(mode, data):
+    path = lambda name: os.path.join(data, name)
+    mono = ['-input-mono1', path('mono-s.txt'), '-input-mono2', path('mono-t.txt'),
+            '-input-par1', path('par-s.txt'), '-input-par2', path('par-t.txt')]
+    if mode == 'bilingual-s':
+        return ['-input', path('sup.txt')] + mono
+    return ['-input', path('empty.txt')] + mono
+
+
+def ntasks(mode, threads):
+    return {'bilingual-um': 3, 'bilingual-umt': 3 * threads, 'bilingual-s': 4}[mode]
+
+
+def run(binary, mode, data, threads, dim, hot, replicas, epoch, extra):
+    out = tempfile.mkdtemp(prefix='ft-scaling-')
+    cmd = [binary, mode] + mode_args(mode, data) + [
+        '-output', os.path.join(out, 'model'), '-thread', str(threads),
+        '-dim', str(dim), '-hotRows', str(hot), '-replicas', str(replicas),
+        '-epoch', str(epoch)] + extra
+
+    t0 = time.time()
+    p = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                         universal_newlines=True)
+    err = []
+    reader = threading.Thread(target=lambda: err.append(p.stderr.read()))
+    reader.start()
+    losses = {}
+    for line in p.stdout:
+        fields = line.strip().split('|')
+        if len(fields) == 4:
+            losses[fields[0]] = float(fields[3])
+    reader.join()
+    _, status, usage = os.wait4(p.pid, 0)
+    wall = time.time() - t0
+    p.returncode = os.waitstatus_to_exitcode(status)
+    subprocess.call(['rm', '-rf', out])
+    if p.returncode != 0:
+        sys.stderr.write(err[0])
+        raise RuntimeError('%s exited with %d' % (' '.join(cmd), p.returncode))
+
+    m = re.search(r'Read (\d+) words in total', err[0])
+    tokens = int(m.group(1)) * epoch * ntasks(mode, threads) if m else 0
+    cores = min(threads, os.cpu_count() or 1)
+    return {
+        'mode': mode,
+        'threads': threads,
+        'dim': dim,
+        'hot_rows': hot,
+        'replicas': replicas,
+        'wall': wall,
+        'tokens': tokens,
+        'tok_s_core': tokens / wall / cores,
+        'rss_mb': usage.ru_maxrss / 1024.0,
+        'loss': sum(losses.values()) / len(losses) if losses else float('nan'),
+    }
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('--data', required=True, help='directory written by gen-corpus.py')
+    p.add_argument('--ft', default='./ft')
+    p.add_argument('--modes', default='bilingual-um,bilingual-umt,bilingual-s')
+    p.add_argument('--threads', default='1,2,4')
+    p.add_argument('--dims', default='10,100')
+    p.add_argument('--hot-rows', default='0', help='comma-separated -hotRows values')
+    p.add_argument('--replicas', default='0', help='comma-separated -replicas values')
+    p.add_argument('--epoch', type=int, default=1)
+    p.add_argument('--json', help='also append one JSON line per run to this file')
+    p.add_argument('extra', nargs=argparse.REMAINDER,
+                   help='extra arguments passed to ft after --')
+    a = p.parse_args()
+    extra = a.extra[1:] if a.extra[:1] == ['--'] else a.extra
+
+    threads = [int(t) for t in a.threads.split(',')]
+    dims = [int(d) for d in a.dims.split(',')]
+    hots = [int(h) for h in a.hot_rows.split(',')]
+    replicas = [int(r) for r in a.replicas.split(',')]
+    header = '%-14s %7s %5s %7s %8s %9s %12s %9s %9s' % (
+        'mode', 'threads', 'dim', 'hot', 'replicas', 'wall', 'tok/s/core', 'rss_mb', 'loss')
+    print(header)
+    print('-' * len(header))
+    sink = open(a.json, 'a') if a.json else None
+    for mode in a.modes.split(','):
+        for t in (threads if mode == 'bilingual-umt' else [1]):
+            for dim in dims:
+                for hot, rep in itertools.product(hots, replicas):
+                    r = run(a.ft, mode, a.data, t, dim, hot, rep, a.epoch, extra)
+                    print('%-14s %7d %5d %7d %8d %9.2f %12.0f %9.1f %9.4f' % (
+                        r['mode'], r['threads'], r['dim'], r['hot_rows'], r['replicas'],
+                        r['wall'], r['tok_s_core'], r['rss_mb'], r['loss']))
+                    sys.stdout.flush()
+                    if sink:
+                        sink.write(json.dumps(r) + '\n')
+                        sink.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "real.h"
+
+namespace alloc {
+
+  struct Block {
+    size_t size;
+    bool mapped;
+  };
+
+  // Mapped blocks by address. Leaked on purpose, like the profile ledger:
+  // static matrices may be released after it would have been destroyed.
+  std::mutex& lock() {
+    static std::mutex* m = new std::mutex();
+    return *m;
+  }
+
+  std::map<uintptr_t, Block>& blocks() {
+    static std::map<uintptr_t, Block>* m = new std::map<uintptr_t, Block>();
+    return *m;
+  }
+
+  static size_t roundUp(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+  }
+
+  int64_t rowStride(int64_t n) {
+    const int64_t line = CACHE_LINE / sizeof(real);
+    if (n >= line) {
+      return roundUp(n, line);
+    }
+    int64_t stride = 1;
+    while (stride < n) stride *= 2;
+    return stride;
+  }
+
+  // Anonymous memory over whole huge pages, starting on a huge page. The
+  // kernel only places a huge page where 2 MB of the mapping are aligned,
+  // so the mapping is made one huge page larger and trimmed.
+  static void* mapHuge(size_t size) {
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+#endif
+    size_t span = size + HUGE_PAGE;
+    char* raw = (char*) mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+    char* start = (char*) roundUp((uintptr_t) raw, HUGE_PAGE);
+    if (start > raw) munmap(raw, start - raw);
+    if (raw + span > start + size) munmap(start + size, raw + span - (start + size));
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+    return start;
+  }
+
+  void* allocate(size_t bytes) {
+    if (bytes == 0) return nullptr;
+    if (int64_t(bytes) >= HUGE_PAGE) {
+      size_t size = roundUp(bytes, HUGE_PAGE);
+      void* p = mapHuge(size);
+      if (p != nullptr) {
+        std::lock_guard<std::mutex> guard(lock());
+        blocks()[(uintptr_t) p] = Block{size, true};
+        return p;
+      }
+    }
+    size_t size = roundUp(bytes, CACHE_LINE);
+    void* p = aligned_alloc(CACHE_LINE, size);
+    if (p == nullptr) {
+      std::cerr << "Cannot allocate " << bytes << " bytes" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    memset(p, 0, size);
+    return p;
+  }
+
+  void release(void* p) {
+    if (p == nullptr) return;
+    {
+      std::lock_guard<std::mutex> guard(lock());
+      auto it = blocks().find((uintptr_t) p);
+      if (it != blocks().end()) {
+        munmap(p, it->second.size);
+        blocks().erase(it);
+        return;
+      }
+    }
+    free(p);
+  }
+
+  // Sums the huge pages of every mapping of smaps that starts inside one of
+  // the blocks (adjacent blocks may have been merged into one mapping).
+  HugePages hugePages() {
+    std::lock_guard<std::mutex> guard(lock());
+    HugePages result{0, 0};
+    for (auto& b : blocks()) {
+      result.requested += b.second.size;
+    }
+    if (result.requested == 0) return result;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool ours = false;
+    while (std::getline(smaps, line)) {
+      uintptr_t start, end;
+      char dash;
+      std::istringstream fields(line);
+      if (line.find(':') == std::string::npos || line.find(':') > line.find(' ')) {
+        fields >> std::hex >> start >> dash >> end;
+        auto it = blocks().upper_bound(start);
+        ours = it != blocks().begin() && start < (--it)->first + it->second.size;
+        continue;
+      }
+      std::string key;
+      int64_t kb;
+      fields >> key >> kb;
+      if (ours && (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:")) {
+        result.backed += kb << 10;
+      }
+    }
+    result.backed = std::min(result.backed, result.requested);
+    return result;
+  }
+}
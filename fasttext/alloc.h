@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_ALLOC_H
+#define FASTTEXT_ALLOC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Storage of Matrix and Vector. Every block is zeroed and starts on a cache
+// line. Blocks of at least one huge page are mapped on their own: from the
+// hugetlbfs pool when the host reserved one (MAP_HUGETLB), otherwise as
+// anonymous memory aligned to 2 MB and marked MADV_HUGEPAGE so that
+// transparent huge pages back it. Their pages are left untouched, so the
+// first thread writing a page decides its NUMA node.
+namespace alloc {
+
+  const int64_t CACHE_LINE = 64;
+  const int64_t HUGE_PAGE = 2 << 20;
+
+  // Reals between the starts of two rows of n reals: a whole number of
+  // cache lines, or a power of two dividing one for short rows, so that a
+  // row never spans more lines than it needs.
+  int64_t rowStride(int64_t);
+
+  void* allocate(size_t);
+  void release(void*);
+
+  // Bytes of the live blocks that asked for huge pages, and how many of
+  // them the kernel backs with huge pages right now (from /proc/self/smaps).
+  struct HugePages {
+    int64_t requested;
+    int64_t backed;
+  };
+  HugePages hugePages();
+}
+
+#endif
@@ -28,6 +28,32 @@ Args::Args() {
   label = "__label__";
   verbose = 2;
 
+  metricsFormat = "json";
+  metricsInterval = 0.5;
+  memBudget = 0;
+  checkpoint = 0;
+  resume = false;
+  warmup = 0;
+  sketch = 0;
+  hotRows = 0;
+  hotSync = 128;
+  hotInput = false;
+  numa = false;
+  replicas = 0;
+  replicaSync = 1000000;
+  workers = 0;
+  syncTokens = 100000;
+  readers = 0;
+  readBatch = 64;
+  batch = 0;
+  batch_sup = 0;
+  batch_mono = 0;
+  batch_par = 0;
+  prefetch = 2;
+  validInterval = 30;
+  patience = 0;
+  lrCut = 0.0;
+
   // Customized
   lrUpdateRate = 100;
   thread = 1;
@@ -48,6 +74,7 @@ void Args::toggleSup() {
   name = "sup_model";
   model = model_name::sup;
   loss = loss_name::softmax;
+  batch = batch_sup;
 
   input_mono1.clear();
   input_mono2.clear();
@@ -60,6 +87,7 @@ void Args::toggleMono(int i) {
   model = model_name::sg;
   loss = loss_name::ns;
   lr = lr_mono;
+  batch = batch_mono;
   
   input.clear();
   input_par1.clear();
@@ -79,6 +107,7 @@ void Args::togglePar() {
   model = model_name::bil;
   loss = loss_name::ns;
   lr = lr_par;
+  batch = batch_par;
   
   input.clear();
   input_mono1.clear();
@@ -167,6 +196,73 @@ void Args::parseArgs(int argc, char** argv) {
       label = std::string(argv[ai + 1]);
     } else if (strcmp(argv[ai], "-verbose") == 0) {
       verbose = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-metrics") == 0) {
+      metrics = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-metricsFormat") == 0) {
+      metricsFormat = std::string(argv[ai + 1]);
+      if (metricsFormat != "json" && metricsFormat != "prom") {
+        std::cout << "Unknown metrics format: " << argv[ai + 1] << std::endl;
+        printHelp();
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[ai], "-metricsInterval") == 0) {
+      metricsInterval = atof(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-memBudget") == 0) {
+      memBudget = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-checkpoint") == 0) {
+      checkpoint = atof(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-resume") == 0) {
+      resume = true;
+      ai += 1;
+      continue;
+    } else if (strcmp(argv[ai], "-pretrained") == 0) {
+      pretrained = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-valid") == 0) {
+      valid = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-validInterval") == 0) {
+      validInterval = atof(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-patience") == 0) {
+      patience = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-lrCut") == 0) {
+      lrCut = atof(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-hotRows") == 0) {
+      hotRows = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-hotSync") == 0) {
+      hotSync = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-hotInput") == 0) {
+      hotInput = true;
+      ai += 1;
+      continue;
+    } else if (strcmp(argv[ai], "-numa") == 0) {
+      numa = true;
+      ai += 1;
+      continue;
+    } else if (strcmp(argv[ai], "-replicas") == 0) {
+      replicas = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-replicaSync") == 0) {
+      replicaSync = atoll(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-workers") == 0) {
+      workers = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-syncTokens") == 0) {
+      syncTokens = atoll(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-readers") == 0) {
+      readers = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-readBatch") == 0) {
+      readBatch = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-batch_sup") == 0) {
+      batch_sup = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-batch_mono") == 0) {
+      batch_mono = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-batch_par") == 0) {
+      batch_par = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-prefetch") == 0) {
+      prefetch = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-sketch") == 0) {
+      sketch = atoi(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-dict") == 0) {
+      dict = std::string(argv[ai + 1]);
+    } else if (strcmp(argv[ai], "-warmup") == 0) {
+      warmup = atof(argv[ai + 1]);
     } else {
       std::cout << "Unknown argument: " << argv[ai] << std::endl;
       printHelp();
@@ -179,6 +275,30 @@ void Args::parseArgs(int argc, char** argv) {
     printHelp();
     exit(EXIT_FAILURE);
   }
+  if (hotSync < 1) {
+    std::cout << "-hotSync must be at least 1." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (prefetch < 0) {
+    std::cout << "-prefetch must be at least 0." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (validInterval <= 0) {
+    std::cout << "-validInterval must be positive." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (patience < 0) {
+    std::cout << "-patience must be at least 0." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (lrCut < 0 || lrCut >= 1) {
+    std::cout << "-lrCut must be in [0, 1)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (warmup < 0 || warmup >= 1) {
+    std::cout << "-warmup must be in [0, 1)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
   if (wordNgrams <= 1 && maxn == 0) {
     bucket = 0;
   }
@@ -207,6 +327,34 @@ void Args::printHelp() {
     << "  -t            sampling threshold [" << t << "]\n"
     << "  -label        labels prefix [" << label << "]\n"
     << "  -verbose      verbosity level [" << verbose << "]\n"
+    << "  -metrics      write training metrics to this file []\n"
+    << "  -metricsFormat metrics file format {json, prom} [" << metricsFormat << "]\n"
+    << "  -metricsInterval seconds between metrics samples [" << metricsInterval << "]\n"
+    << "  -memBudget    abort before allocating if more MB would be needed, 0 for no limit [" << memBudget << "]\n"
+    << "  -checkpoint   seconds between checkpoints to <output>.ckpt, 0 to disable [" << checkpoint << "]\n"
+    << "  -resume       resume training from <output>.ckpt\n"
+    << "  -pretrained   continue training this .bin model, adding new frequent words []\n"
+    << "  -valid        held-out supervised data, scored while bilingual-s trains and after each sweep trial []\n"
+    << "  -validInterval seconds between two scores of -valid during training [" << validInterval << "]\n"
+    << "  -patience     scores of -valid without a new best P@1 before -lrCut applies, 0 to disable [" << patience << "]\n"
+    << "  -lrCut        factor applied to the learning rates on a plateau, 0 to stop training instead [" << lrCut << "]\n"
+    << "  -hotRows      per-task, per-thread copies of the output rows of this many most frequent words, 0 to disable [" << hotRows << "]\n"
+    << "  -hotSync      updates between merges of the per-thread rows into the shared matrix [" << hotSync << "]\n"
+    << "  -hotInput     also keep per-thread copies of their input rows\n"
+    << "  -numa         bilingual-umt: one model replica per NUMA node, threads bound to their node\n"
+    << "  -replicas     bilingual-umt: number of model replicas, 0 for one (or one per node with -numa) [" << replicas << "]\n"
+    << "  -replicaSync  trained tokens between two averages of the replicas [" << replicaSync << "]\n"
+    << "  -workers      bilingual-um: train in this many processes, each on a shard of the input [" << workers << "]\n"
+    << "  -syncTokens   tokens a worker trains between two averaging rounds [" << syncTokens << "]\n"
+    << "  -readers      threads parsing the input ahead of the trainers, 0 to parse in the trainers [" << readers << "]\n"
+    << "  -readBatch    examples per batch handed from a reader to a trainer [" << readBatch << "]\n"
+    << "  -batch_sup    train the supervised task on mini-batches of this many examples, 0 for one at a time [" << batch_sup << "]\n"
+    << "  -batch_mono   same for the monolingual tasks, in (word, context) pairs [" << batch_mono << "]\n"
+    << "  -batch_par    same for the parallel task, in (word, translation) pairs [" << batch_par << "]\n"
+    << "  -prefetch     skipgram updates ahead whose rows are prefetched, 0 to disable [" << prefetch << "]\n"
+    << "  -sketch       count the vocabulary in two passes through a count-min sketch of this many MB, 0 to count exactly [" << sketch << "]\n"
+    << "  -dict         load the vocabulary from this build-dict file instead of counting the input []\n"
+    << "  -warmup       fraction of training spent ramping up the learning rate [" << warmup << "]\n"
     << std::endl;
 }
 
@@ -241,3 +389,22 @@ void Args::load(std::istream& in) {
   in.read((char*) &(lrUpdateRate), sizeof(int));
   in.read((char*) &(t), sizeof(double));
 }
+
+// The fields that fix the shape of the dictionary and matrices; a model
+// trained further must keep those of the model it starts from.
+void Args::copyStructure(const Args& other) {
+  dim = other.dim;
+  bucket = other.bucket;
+  minn = other.minn;
+  maxn = other.maxn;
+  wordNgrams = other.wordNgrams;
+}
+
+// Learning rate at `progress` for a task whose base rate is `base`: a linear
+// ramp over the first `warmup` fraction, then a linear decay to zero.
+double Args::schedule(double base, double progress) const {
+  if (progress < warmup) {
+    return base * progress / warmup;
+  }
+  return base * (1.0 - progress) / (1.0 - warmup);
+}
@@ -54,10 +54,42 @@ class Args {
     std::string label;
     int verbose;
 
+    std::string metrics;
+    std::string metricsFormat;
+    double metricsInterval;
+    int memBudget;
+    double checkpoint;
+    bool resume;
+    std::string pretrained;
+    std::string valid;
+    double validInterval;
+    int patience;
+    double lrCut;
+    std::string dict;
+    int sketch;
+    int hotRows;
+    int hotSync;
+    bool hotInput;
+    bool numa;
+    int replicas;
+    int64_t replicaSync;
+    int workers;
+    int64_t syncTokens;
+    int readers;
+    int readBatch;
+    int batch;
+    int batch_sup;
+    int batch_mono;
+    int batch_par;
+    int prefetch;
+    double warmup;
+
     void parseArgs(int, char**);
     void printHelp();
     void save(std::ostream&);
     void load(std::istream&);
+    void copyStructure(const Args&);
+    double schedule(double, double) const;
     
     void toggleSup();
     void toggleMono(const int);
@@ -0,0 +1,418 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "biltext.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "fasttext.h"
+#include "flat.h"
+#include "matrix.h"
+#include "model.h"
+#include "vector.h"
+
+namespace {
+
+  thread_local std::string lastError;
+
+  int fail(const std::string& message) {
+    lastError = message;
+    return BT_ERROR;
+  }
+
+  // An istream over a mapped file, for the parts of a model that are parsed
+  // rather than mapped.
+  class MemoryBuf : public std::streambuf {
+    public:
+      MemoryBuf(const char* data, size_t size) {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+      }
+      size_t position() const {
+        return gptr() - eback();
+      }
+
+    protected:
+      pos_type seekpos(pos_type pos, std::ios_base::openmode) override {
+        if (pos < 0 || pos > egptr() - eback()) return pos_type(off_type(-1));
+        setg(eback(), eback() + pos, egptr());
+        return pos;
+      }
+  };
+
+  // The buffers of one call. A model keeps those of finished calls for the
+  // next ones, so that only a new peak of concurrent calls allocates.
+  struct Scratch {
+    std::unique_ptr<Model> model;
+    Vector vec;
+    std::vector<int32_t> words;
+    std::vector<int32_t> labels;
+    std::vector<int32_t> rows;
+    std::vector<std::pair<real, int32_t>> heap;
+
+    explicit Scratch(int32_t dim) : vec(dim) {}
+  };
+
+  bool compareScores(const std::pair<real, int32_t>& l, const std::pair<real, int32_t>& r) {
+    return l.first > r.first;
+  }
+}
+
+struct bt_model {
+  std::shared_ptr<Args> args;
+  std::shared_ptr<Dictionary> dict;
+  std::shared_ptr<Matrix> input;
+  std::shared_ptr<Matrix> output;
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Scratch>> scratch;
+
+  std::once_flag normalized;
+  std::unique_ptr<Matrix> wordVectors;
+};
+
+namespace {
+
+  // Scratch buffers for the duration of one call.
+  class Lease {
+    private:
+      bt_model* model_;
+      std::unique_ptr<Scratch> scratch_;
+
+    public:
+      explicit Lease(bt_model* model) : model_(model) {
+        {
+          std::lock_guard<std::mutex> lock(model->mutex);
+          if (!model->scratch.empty()) {
+            scratch_ = std::move(model->scratch.back());
+            model->scratch.pop_back();
+          }
+        }
+        if (!scratch_) {
+          scratch_.reset(new Scratch(model->args->dim));
+          if (model->args->model == model_name::sup) {
+            // Predicting only needs the shared matrices: no per-thread rows
+            // and no mini-batch engine.
+            std::shared_ptr<Args> args = std::make_shared<Args>(*model->args);
+            args->hotRows = 0;
+            args->batch = 0;
+            scratch_->model.reset(new Model(model->input, model->output, args, 0));
+            if (args->loss == loss_name::hs) {
+              scratch_->model->setTargetCounts(model->dict->getCounts(entry_type::label), model->dict);
+            }
+          }
+        }
+      }
+      ~Lease() {
+        std::lock_guard<std::mutex> lock(model_->mutex);
+        model_->scratch.push_back(std::move(scratch_));
+      }
+      Scratch& operator*() {
+        return *scratch_;
+      }
+  };
+
+  // The words and labels of `text` up to its first newline, as getLine reads
+  // a line of a supervised corpus.
+  void tokenize(Dictionary& dict, const char* text, std::vector<int32_t>& words,
+                std::vector<int32_t>& labels) {
+    words.clear();
+    labels.clear();
+    const char* p = text;
+    while (*p != '\0' && *p != '\n') {
+      if (isspace(*p)) {
+        p++;
+        continue;
+      }
+      const char* start = p;
+      while (*p != '\0' && !isspace(*p)) p++;
+      std::string_view token(start, p - start);
+      token_info t = dict.lookup(token, Dictionary::hash(token));
+      if (t.id < 0) continue;
+      if (t.type == entry_type::word) {
+        words.push_back(t.id);
+      } else if (t.type == entry_type::label) {
+        labels.push_back(t.id - dict.nwords());
+      }
+    }
+  }
+
+  // The mean of the input rows `rows` into `out`; zero without rows.
+  void average(const Matrix& input, const std::vector<int32_t>& rows, Vector& vec, float* out) {
+    vec.zero();
+    for (int32_t row : rows) {
+      vec.addRow(input, row);
+    }
+    if (rows.size() > 0) {
+      vec.mul(1.0 / rows.size());
+    }
+    std::copy(vec.data_, vec.data_ + vec.m_, out);
+  }
+
+  void normalize(float* x, int64_t n) {
+    double norm = 0.0;
+    for (int64_t j = 0; j < n; j++) {
+      norm += x[j] * x[j];
+    }
+    if (norm > 0) {
+      real inv = 1.0 / sqrt(norm);
+      for (int64_t j = 0; j < n; j++) {
+        x[j] *= inv;
+      }
+    }
+  }
+
+  // Reads the matrices of a model, which start at `position` of `in`. With
+  // a mapping, they are read in place, unless the file is older than
+  // version 2 and puts them off a 4-byte boundary.
+  bool loadMatrices(std::istream& in, size_t position, int32_t version,
+                    std::shared_ptr<MappedFile> mapping, Matrix& input, Matrix& output) {
+    if (!mapping) {
+      for (Matrix* matrix : {&input, &output}) {
+        if (version >= 2) Matrix::skipPadding(in);
+        matrix->load(in);
+      }
+      return bool(in);
+    }
+    for (Matrix* matrix : {&input, &output}) {
+      if (version >= 2) position = Matrix::alignedOffset(position);
+      int64_t header[2];
+      if (position + sizeof(header) > mapping->size()) return false;
+      memcpy(header, mapping->data() + position, sizeof(header));
+      position += sizeof(header);
+      int64_t m = header[0], n = header[1];
+      if (m < 0 || n < 0 || position + m * n * sizeof(real) > mapping->size()) return false;
+      if (position % sizeof(real) == 0) {
+        matrix->view(mapping, (const real*) (mapping->data() + position), m, n);
+      } else {
+        MemoryBuf buf(mapping->data() + position - sizeof(header), mapping->size() - position + sizeof(header));
+        std::istream rows(&buf);
+        matrix->load(rows);
+      }
+      position += m * n * sizeof(real);
+    }
+    return true;
+  }
+}
+
+extern "C" {
+
+int bt_api_version(void) {
+  return BT_API_VERSION;
+}
+
+const char* bt_error(void) {
+  return lastError.c_str();
+}
+
+bt_model* bt_load(const char* path, int flags) {
+  std::shared_ptr<MappedFile> mapping;
+  std::ifstream file;
+  std::unique_ptr<MemoryBuf> buf;
+  std::unique_ptr<std::istream> stream;
+  if (flags & BT_LOAD_MMAP) {
+    mapping = std::make_shared<MappedFile>();
+    if (!mapping->open(path)) {
+      fail(std::string(path) + " cannot be mapped");
+      return nullptr;
+    }
+    buf.reset(new MemoryBuf(mapping->data(), mapping->size()));
+    stream.reset(new std::istream(buf.get()));
+  } else {
+    file.open(path, std::ifstream::binary);
+    if (!file.is_open()) {
+      fail(std::string(path) + " cannot be opened");
+      return nullptr;
+    }
+  }
+  std::istream& in = stream ? *stream : file;
+
+  // readModelHeader, without exiting on a newer file.
+  int32_t magic, version = 0;
+  in.read((char*) &magic, sizeof(int32_t));
+  if (magic == FASTTEXT_FILEFORMAT_MAGIC_INT32) {
+    in.read((char*) &version, sizeof(int32_t));
+    if (version > FASTTEXT_VERSION) {
+      fail(std::string(path) + " has a model format newer than this library");
+      return nullptr;
+    }
+  } else {
+    in.clear();
+    in.seekg(0);
+  }
+
+  std::unique_ptr<bt_model> model(new bt_model());
+  model->args = std::make_shared<Args>();
+  model->args->load(in);
+  if (!in || model->args->dim <= 0) {
+    fail(std::string(path) + " is not a model file");
+    return nullptr;
+  }
+  model->dict = std::make_shared<Dictionary>(model->args);
+  model->dict->load(in, version);
+  model->input = std::make_shared<Matrix>();
+  model->output = std::make_shared<Matrix>();
+  size_t position = buf ? buf->position() : 0;
+  if (!in || !loadMatrices(in, position, version, mapping, *model->input, *model->output) ||
+      model->input->n_ != model->args->dim || model->output->n_ != model->args->dim) {
+    fail(std::string(path) + " is truncated");
+    return nullptr;
+  }
+  return model.release();
+}
+
+void bt_free(bt_model* model) {
+  delete model;
+}
+
+int32_t bt_dim(const bt_model* model) {
+  return model->args->dim;
+}
+
+int32_t bt_nwords(const bt_model* model) {
+  return model->dict->nwords();
+}
+
+int32_t bt_nlabels(const bt_model* model) {
+  return model->dict->nlabels();
+}
+
+static int32_t copyEntry(std::string_view entry, char* buf, int32_t size) {
+  if (size > 0) {
+    size_t len = std::min(entry.size(), size_t(size - 1));
+    memcpy(buf, entry.data(), len);
+    buf[len] = '\0';
+  }
+  return entry.size();
+}
+
+int32_t bt_word(const bt_model* model, int32_t id, char* buf, int32_t size) {
+  if (id < 0 || id >= model->dict->nwords()) return -1;
+  return copyEntry(model->dict->getEntry(id), buf, size);
+}
+
+int32_t bt_label(const bt_model* model, int32_t id, char* buf, int32_t size) {
+  if (id < 0 || id >= model->dict->nlabels()) return -1;
+  return copyEntry(model->dict->getEntry(model->dict->nwords() + id), buf, size);
+}
+
+int bt_predict(bt_model* model, const char* const* texts, int32_t n, int32_t k,
+               int32_t* labels, float* probs) {
+  if (model->args->model != model_name::sup) {
+    return fail("bt_predict needs a supervised model");
+  }
+  if (k < 1) {
+    return fail("bt_predict needs k >= 1");
+  }
+  Lease lease(model);
+  Scratch& s = *lease;
+  for (int32_t i = 0; i < n; i++) {
+    tokenize(*model->dict, texts[i], s.words, s.labels);
+    s.heap.clear();
+    if (!s.words.empty()) {
+      model->dict->addNgrams(s.words, model->args->wordNgrams);
+      s.model->predict(s.words, k, s.heap);
+    }
+    for (int32_t j = 0; j < k; j++) {
+      bool found = j < s.heap.size();
+      labels[i * k + j] = found ? s.heap[j].second : -1;
+      probs[i * k + j] = found ? exp(s.heap[j].first) : 0.0;
+    }
+  }
+  return BT_OK;
+}
+
+int bt_word_vectors(bt_model* model, const char* const* words, int32_t n, float* out) {
+  Lease lease(model);
+  Scratch& s = *lease;
+  const int32_t dim = model->args->dim;
+  for (int32_t i = 0; i < n; i++) {
+    model->dict->getNgrams(words[i], s.rows);
+    average(*model->input, s.rows, s.vec, out + int64_t(i) * dim);
+  }
+  return BT_OK;
+}
+
+int bt_sentence_vectors(bt_model* model, const char* const* texts, int32_t n, float* out) {
+  Lease lease(model);
+  Scratch& s = *lease;
+  const int32_t dim = model->args->dim;
+  for (int32_t i = 0; i < n; i++) {
+    tokenize(*model->dict, texts[i], s.words, s.labels);
+    model->dict->getSentenceRows(s.words, s.rows);
+    average(*model->input, s.rows, s.vec, out + int64_t(i) * dim);
+  }
+  return BT_OK;
+}
+
+int bt_nearest_neighbors(bt_model* model, const char* word, int32_t k, int32_t* ids,
+                         float* scores) {
+  if (k < 1) {
+    return fail("bt_nearest_neighbors needs k >= 1");
+  }
+  Dictionary& dict = *model->dict;
+  const int32_t dim = model->args->dim;
+  std::call_once(model->normalized, [&]() {
+    std::unique_ptr<Matrix> vectors(new Matrix(dict.nwords(), dim));
+    std::vector<int32_t> rows;
+    Vector vec(dim);
+    for (int32_t i = 0; i < dict.nwords(); i++) {
+      id_range ngrams = dict.getNgrams(i);
+      rows.assign(ngrams.cbegin(), ngrams.cend());
+      real* row = vectors->data_ + i * vectors->stride_;
+      average(*model->input, rows, vec, row);
+      normalize(row, dim);
+    }
+    model->wordVectors = std::move(vectors);
+  });
+
+  Lease lease(model);
+  Scratch& s = *lease;
+  dict.getNgrams(word, s.rows);
+  average(*model->input, s.rows, s.vec, s.vec.data_);
+  normalize(s.vec.data_, dim);
+  int32_t self = dict.getId(word);
+  s.heap.clear();
+  s.heap.reserve(k + 1);
+  for (int32_t i = 0; i < dict.nwords(); i++) {
+    if (i == self) continue;
+    real score = model->wordVectors->dotRow(s.vec, i);
+    if (s.heap.size() == k && score < s.heap.front().first) continue;
+    s.heap.push_back(std::make_pair(score, i));
+    std::push_heap(s.heap.begin(), s.heap.end(), compareScores);
+    if (s.heap.size() > k) {
+      std::pop_heap(s.heap.begin(), s.heap.end(), compareScores);
+      s.heap.pop_back();
+    }
+  }
+  std::sort_heap(s.heap.begin(), s.heap.end(), compareScores);
+  for (int32_t j = 0; j < k; j++) {
+    bool found = j < s.heap.size();
+    ids[j] = found ? s.heap[j].second : -1;
+    scores[j] = found ? s.heap[j].first : 0.0;
+  }
+  return BT_OK;
+}
+
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_BILTEXT_H
+#define FASTTEXT_BILTEXT_H
+
+/*
+ * C API of libbiltext.so (make lib): inference on a trained .bin model
+ * from another process, without spawning `ft`.
+ *
+ * Any number of threads may call the functions below on the same model at
+ * once, between bt_load and bt_free. Results go to buffers the caller owns
+ * and sizes as documented; once a model has served as many concurrent calls
+ * as it will ever see, calls do no heap allocation.
+ *
+ * Texts are NUL-terminated UTF-8 and are tokenized as the trainer does,
+ * up to their first newline. Functions returning int return BT_OK, or a
+ * negative error whose message bt_error() gives in the calling thread.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_API_VERSION 1
+
+#define BT_OK 0
+#define BT_ERROR -1
+
+/* bt_load flags. */
+#define BT_LOAD_MMAP 1 /* read the matrices in place from the file */
+
+typedef struct bt_model bt_model;
+
+int bt_api_version(void);
+const char* bt_error(void);
+
+/* NULL on failure. With BT_LOAD_MMAP, the matrices are mapped from the
+ * file rather than copied (when the file lays them out on a 4-byte
+ * boundary) and the file must not change while the model is loaded. */
+bt_model* bt_load(const char* path, int flags);
+void bt_free(bt_model* model);
+
+int32_t bt_dim(const bt_model* model);
+int32_t bt_nwords(const bt_model* model);
+int32_t bt_nlabels(const bt_model* model);
+
+/* Copies word or label `id` into `buf` of `size` bytes, NUL-terminated and
+ * truncated if needed, and returns its full length, or -1 for a bad id. */
+int32_t bt_word(const bt_model* model, int32_t id, char* buf, int32_t size);
+int32_t bt_label(const bt_model* model, int32_t id, char* buf, int32_t size);
+
+/* Supervised models: the k most likely labels of each of the n texts, best
+ * first, into labels[n * k] and probs[n * k]. Slots past the number of
+ * labels, or of a text without known words, get label -1 and prob 0. */
+int bt_predict(bt_model* model, const char* const* texts, int32_t n, int32_t k,
+               int32_t* labels, float* probs);
+
+/* The vectors of n words, words out of the vocabulary built from their
+ * subwords, into out[n * dim]. */
+int bt_word_vectors(bt_model* model, const char* const* words, int32_t n, float* out);
+
+/* The vectors of n texts, as print-sentence-vectors computes them, into
+ * out[n * dim]. */
+int bt_sentence_vectors(bt_model* model, const char* const* texts, int32_t n, float* out);
+
+/* The k words whose vectors have the highest cosine similarity with that
+ * of `word`, itself excluded, into ids[k] and scores[k]; missing slots get
+ * id -1. The normalized vectors of the vocabulary are computed on the
+ * first call. */
+int bt_nearest_neighbors(bt_model* model, const char* word, int32_t k, int32_t* ids,
+                         float* scores);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
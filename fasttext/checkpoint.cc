@@ -0,0 +1,252 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "fasttext.h"
+#include "profile.h"
+
+Checkpoint::Checkpoint(std::shared_ptr<Args> args) {
+  args_ = args;
+  running_ = false;
+}
+
+Checkpoint::~Checkpoint() {
+  stop(false);
+}
+
+std::string Checkpoint::path() const {
+  return args_->output + ".ckpt";
+}
+
+std::shared_ptr<Dictionary> Checkpoint::restore() {
+  std::ifstream in(path(), std::ifstream::binary);
+  if (!in.is_open()) {
+    std::cerr << "No checkpoint to resume from at " << path() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  int32_t magic, version;
+  in.read((char*) &magic, sizeof(int32_t));
+  in.read((char*) &version, sizeof(int32_t));
+  if (magic != MAGIC || version != VERSION) {
+    std::cerr << path() << " is not a checkpoint this binary can read." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  Args stored;
+  stored.load(in);
+  if (stored.dim != args_->dim || stored.bucket != args_->bucket ||
+      stored.minn != args_->minn || stored.maxn != args_->maxn ||
+      stored.epoch != args_->epoch) {
+    std::cerr << "Checkpoint was written with a different -dim, -bucket, -minn, "
+              << "-maxn or -epoch; resume with the original arguments." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Same arguments minus the inputs, so that the constructor does not read
+  // the corpora again.
+  std::shared_ptr<Args> dargs = std::make_shared<Args>(*args_);
+  dargs->input.clear();
+  dargs->input_mono1.clear();
+  dargs->input_mono2.clear();
+  dargs->dict.clear();
+  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(dargs);
+  dict->load(in, FASTTEXT_VERSION);
+
+  int32_t n;
+  in.read((char*) &n, sizeof(int32_t));
+  for (int32_t i = 0; i < n; i++) {
+    std::string name;
+    std::getline(in, name, '\0');
+    std::shared_ptr<Matrix> m = std::make_shared<Matrix>();
+    m->load(in);
+    restoredMatrices_[name] = m;
+  }
+  in.read((char*) &n, sizeof(int32_t));
+  for (int32_t i = 0; i < n; i++) {
+    std::string task;
+    int32_t threadId;
+    int64_t size;
+    std::getline(in, task, '\0');
+    in.read((char*) &threadId, sizeof(int32_t));
+    in.read((char*) &size, sizeof(int64_t));
+    std::string state(size, '\0');
+    in.read(&state[0], size);
+    restored_[std::make_pair(task, threadId)] = state;
+  }
+  if (!in) {
+    std::cerr << "Checkpoint " << path() << " is truncated." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cerr << "Resuming from " << path() << std::endl;
+  return dict;
+}
+
+void Checkpoint::restoreMatrix(const std::string& name, std::shared_ptr<Matrix> m) {
+  auto it = restoredMatrices_.find(name);
+  if (it == restoredMatrices_.end() || it->second->m_ != m->m_ || it->second->n_ != m->n_) {
+    std::cerr << "Checkpoint has no " << m->m_ << "x" << m->n_ << " matrix " << name << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  memcpy(m->data_, it->second->data_, m->m_ * m->stride_ * sizeof(real));
+  restoredMatrices_.erase(it);
+}
+
+std::string Checkpoint::restoredState(const std::string& task, int32_t threadId) const {
+  auto it = restored_.find(std::make_pair(task, threadId));
+  if (it == restored_.end()) {
+    std::cerr << "Checkpoint has no state for " << task << " thread " << threadId
+              << "; resume with the original -thread." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return it->second;
+}
+
+void Checkpoint::setDictionary(std::shared_ptr<Dictionary> dict) {
+  dict_ = dict;
+}
+
+void Checkpoint::addMatrix(const std::string& name, std::shared_ptr<Matrix> m) {
+  matrices_.push_back(std::make_pair(name, m));
+}
+
+CheckpointSlot* Checkpoint::registerTask(const std::string& task, int32_t threadId) {
+  if (args_->checkpoint <= 0) return nullptr;
+  std::unique_ptr<CheckpointSlot> slot(new CheckpointSlot());
+  slot->task = task;
+  slot->threadId = threadId;
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_.push_back(std::move(slot));
+  return slots_.back().get();
+}
+
+int64_t Checkpoint::publish(CheckpointSlot* slot, const std::string& state, bool done) {
+  int64_t generation = generation_.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(slot->mutex);
+    slot->state = state;
+    slot->generation = generation;
+    slot->done = done;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  cv_.notify_all();
+  return generation;
+}
+
+void Checkpoint::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (args_->checkpoint <= 0 || running_) return;
+  running_ = true;
+  writer_ = std::thread([this]() { run(); });
+}
+
+void Checkpoint::stop(bool finished) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  writer_.join();
+  if (finished) {
+    remove(path().c_str());
+  }
+}
+
+void Checkpoint::run() {
+  auto interval = std::chrono::duration<double>(args_->checkpoint);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, interval, [this]() { return !running_; });
+      if (!running_) return;
+    }
+    if (collect(generation_.fetch_add(1) + 1)) {
+      write();
+    }
+  }
+}
+
+// Waits until every task that is still training has published its state
+// for `generation`.
+bool Checkpoint::collect(int64_t generation) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cv_.wait_for(lock, std::chrono::seconds(60), [&]() {
+    if (!running_) return true;
+    for (auto& slot : slots_) {
+      std::lock_guard<std::mutex> guard(slot->mutex);
+      if (!slot->done && slot->generation < generation) return false;
+    }
+    return true;
+  }) && running_;
+}
+
+void Checkpoint::write() {
+  profile::Phase phase("checkpoint");
+  if (snapshots_.empty()) {
+    for (auto& m : matrices_) {
+      snapshots_.emplace_back(new Matrix(m.second->m_, m.second->n_));
+      snapshots_.back()->account_.rename("checkpoint.snapshot");
+    }
+  }
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    const Matrix& src = *matrices_[i].second;
+    memcpy(snapshots_[i]->data_, src.data_, src.m_ * src.stride_ * sizeof(real));
+  }
+
+  std::string tmp = path() + ".tmp";
+  std::ofstream out(tmp, std::ofstream::binary);
+  if (!out.is_open()) {
+    std::cerr << "Checkpoint file cannot be opened for saving!" << std::endl;
+    return;
+  }
+  int32_t magic = MAGIC, version = VERSION;
+  out.write((char*) &magic, sizeof(int32_t));
+  out.write((char*) &version, sizeof(int32_t));
+  args_->save(out);
+  dict_->save(out);
+  int32_t n = matrices_.size();
+  out.write((char*) &n, sizeof(int32_t));
+  for (size_t i = 0; i < matrices_.size(); i++) {
+    out.write(matrices_[i].first.c_str(), matrices_[i].first.size() + 1);
+    snapshots_[i]->save(out);
+  }
+
+  std::vector<CheckpointSlot*> slots;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) slots.push_back(slot.get());
+  }
+  n = slots.size();
+  out.write((char*) &n, sizeof(int32_t));
+  for (auto slot : slots) {
+    std::lock_guard<std::mutex> guard(slot->mutex);
+    int64_t size = slot->state.size();
+    out.write(slot->task.c_str(), slot->task.size() + 1);
+    out.write((char*) &slot->threadId, sizeof(int32_t));
+    out.write((char*) &size, sizeof(int64_t));
+    out.write(slot->state.data(), size);
+  }
+  out.close();
+  if (!out) {
+    std::cerr << "Checkpoint could not be written to " << tmp << std::endl;
+    return;
+  }
+  rename(tmp.c_str(), path().c_str());
+  if (args_->verbose > 2) {
+    std::cerr << "\nCheckpoint written to " << path() << std::endl;
+  }
+}
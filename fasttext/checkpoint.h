@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_CHECKPOINT_H
+#define FASTTEXT_CHECKPOINT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+
+// Serialized training state of one (task, thread) pair, published by its
+// training thread between two steps.
+struct CheckpointSlot {
+  std::string task;
+  int32_t threadId;
+  std::mutex mutex;
+  std::string state;
+  int64_t generation{0};
+  bool done{false};
+};
+
+// Periodically writes `<output>.ckpt` from a background thread: the shared
+// matrices are memcpy'd into a second buffer (Hogwild-style, without
+// stopping the trainers) and written from there, together with the
+// dictionary and the last state every task published. Training threads only
+// poll an atomic generation counter once per step.
+class Checkpoint {
+  private:
+    static const int32_t MAGIC = 0x424b4350;
+    static const int32_t VERSION = 2;
+
+    std::shared_ptr<Args> args_;
+    std::shared_ptr<Dictionary> dict_;
+    std::vector<std::pair<std::string, std::shared_ptr<Matrix>>> matrices_;
+    std::vector<std::unique_ptr<Matrix>> snapshots_;
+    std::vector<std::unique_ptr<CheckpointSlot>> slots_;
+    std::map<std::pair<std::string, int32_t>, std::string> restored_;
+    std::map<std::string, std::shared_ptr<Matrix>> restoredMatrices_;
+
+    std::atomic<int64_t> generation_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread writer_;
+    bool running_;
+
+    void run();
+    bool collect(int64_t);
+    void write();
+
+  public:
+    explicit Checkpoint(std::shared_ptr<Args>);
+    ~Checkpoint();
+
+    std::string path() const;
+    std::shared_ptr<Dictionary> restore();
+    void restoreMatrix(const std::string&, std::shared_ptr<Matrix>);
+    std::string restoredState(const std::string&, int32_t) const;
+
+    void setDictionary(std::shared_ptr<Dictionary>);
+    void addMatrix(const std::string&, std::shared_ptr<Matrix>);
+    CheckpointSlot* registerTask(const std::string&, int32_t);
+
+    inline bool requested(int64_t seen) const {
+      return generation_.load(std::memory_order_relaxed) != seen;
+    }
+    int64_t publish(CheckpointSlot*, const std::string&, bool);
+
+    void start();
+    void stop(bool);
+};
+
+#endif
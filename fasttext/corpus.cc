@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "corpus.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "input.h"
+
+// One entry per Dictionary::getLine call a trainer would make on a fresh
+// stream, the last one being the call that reaches the end of the file
+// (empty when the file ends with a newline), so that the wrap-around
+// behaves the same.
+Corpus::Corpus(std::shared_ptr<Dictionary> dict, const std::string& filename)
+  : account_("corpus") {
+  profile::Phase phase("corpus.load");
+  InputStream in(filename);
+  if (!in.is_open()) {
+    std::cerr << filename << " cannot be opened for training!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::string token;
+  uint32_t h;
+  lines_.push_back(0);
+  while (true) {
+    while (dict->readToken(in, token, h)) {
+      if (token == Dictionary::EOS) break;
+      token_info t = dict->lookup(token, h);
+      if (t.id < 0) continue;
+      if (t.type == entry_type::word) {
+        tokens_.push_back(t.id);
+      } else if (t.type == entry_type::label) {
+        tokens_.push_back(-1 - (t.id - dict->nwords()));
+      }
+    }
+    lines_.push_back(tokens_.size());
+    if (in.eof()) break;
+  }
+  account_.set(tokens_.capacity() * sizeof(int32_t) + lines_.capacity() * sizeof(int64_t));
+}
+
+int64_t Corpus::nlines() const {
+  return lines_.size() - 1;
+}
+
+// Like ExampleReader::skipLines on the file: the rest of the current line
+// counts as one.
+void Corpus::skipLines(Cursor& cursor, int64_t n) const {
+  for (int64_t i = 0; i < n; i++) {
+    if (cursor.line >= nlines()) {
+      cursor.line = 0;
+    }
+    cursor.line++;
+    cursor.token = lines_[cursor.line];
+  }
+}
+
+int32_t Corpus::getLine(Cursor& cursor, Dictionary& dict, std::vector<int32_t>& words,
+                        std::vector<int32_t>& labels, model_name mname, real u) const {
+  words.clear();
+  labels.clear();
+  if (cursor.line >= nlines()) {
+    cursor.line = 0;
+    cursor.token = 0;
+  }
+  int32_t ntokens = 0;
+  const int64_t end = lines_[cursor.line + 1];
+  while (cursor.token < end) {
+    int32_t id = tokens_[cursor.token++];
+    ntokens++;
+    if (id >= 0) {
+      if (!dict.discard(id, mname, u)) {
+        words.push_back(id);
+      }
+    } else {
+      labels.push_back(-1 - id);
+    }
+    if (words.size() > Dictionary::MAX_LINE_SIZE && mname != model_name::sup) {
+      return ntokens;
+    }
+  }
+  cursor.line++;
+  return ntokens;
+}
+
+CorpusCache::CorpusCache(std::shared_ptr<Dictionary> dict) : dict_(dict) {}
+
+std::shared_ptr<Corpus> CorpusCache::get(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<Corpus>& corpus = corpora_[filename];
+  if (!corpus) {
+    corpus = std::make_shared<Corpus>(dict_, filename);
+  }
+  return corpus;
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_CORPUS_H
+#define FASTTEXT_CORPUS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "profile.h"
+
+// A corpus tokenized once and kept in memory: the ids of every line before
+// subsampling, labels included, in file order. getLine replays it the way
+// Dictionary::getLine reads the file, so that trainers sharing a Corpus
+// see the examples they would have parsed themselves.
+class Corpus {
+  private:
+    // Word ids, and labels as -1 - label.
+    std::vector<int32_t> tokens_;
+    // Start of each line in tokens_, then tokens_.size().
+    std::vector<int64_t> lines_;
+    profile::Account account_;
+
+  public:
+    // A position in the corpus: a line and a token of it.
+    struct Cursor {
+      int64_t line;
+      int64_t token;
+    };
+
+    Corpus(std::shared_ptr<Dictionary>, const std::string&);
+
+    int64_t nlines() const;
+    void skipLines(Cursor&, int64_t) const;
+    int32_t getLine(Cursor&, Dictionary&, std::vector<int32_t>&, std::vector<int32_t>&,
+                    model_name, real) const;
+};
+
+// The corpora of a set of trainers, by file name, each tokenized on first
+// use.
+class CorpusCache {
+  private:
+    std::shared_ptr<Dictionary> dict_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Corpus>> corpora_;
+
+  public:
+    explicit CorpusCache(std::shared_ptr<Dictionary>);
+
+    std::shared_ptr<Corpus> get(const std::string&);
+};
+
+#endif
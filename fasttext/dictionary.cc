@@ -11,57 +11,131 @@
 
 #include <assert.h>
 
+#include <string.h>
+
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <iterator>
+#include <numeric>
 #include <unordered_map>
 #include <cctype>
 
+#include "input.h"
+#include "sketch.h"
+
 const std::string Dictionary::EOS = "</s>";
 const std::string Dictionary::BOW = "<";
 const std::string Dictionary::EOW = ">";
 
-Dictionary::Dictionary(std::shared_ptr<Args> args) {
+Dictionary::Dictionary(std::shared_ptr<Args> args)
+  : word2intAccount_("dictionary.word2int"), wordsAccount_("dictionary.words"),
+    subwordsAccount_("dictionary.subwords"), pdiscardAccount_("dictionary.pdiscard"),
+    mappedAccount_("dictionary.mapped") {
   args_ = args;
   size_ = 0;
   nwords_ = 0;
   nlabels_ = 0;
   ntokens_ = 0;
+  bucketStart_ = 0;
+  frozen_ = 0;
+  static_assert(MAX_VOCAB_SIZE < SLOT_ID_MASK, "word ids do not fit in a slot");
   word2int_.resize(MAX_VOCAB_SIZE);
   for (int32_t i = 0; i < MAX_VOCAB_SIZE; i++) {
-    word2int_[i] = -1;
+    word2int_[i] = 0;
   }
+  clearEntries();
+  account();
   
 //  std::vector<std::string> possible_inputs = {args->input, args->input_mono1, args->input_mono2, args->input_par1, args->input_par2};
   std::vector<std::string> possible_inputs = {args->input, args->input_mono1, args->input_mono2};
   
-  readFromFile(possible_inputs);
+  if (!args->dict.empty()) {
+    loadFromFile(args->dict);
+  } else {
+    readFromFile(possible_inputs);
+  }
 }
 
-int32_t Dictionary::find(const std::string& w) {
-  int32_t h = hash(w) % MAX_VOCAB_SIZE;
-  while (word2int_[h] != -1 && words_[word2int_[h]].word != w) {
+int32_t Dictionary::find(std::string_view w) const {
+  return find(w, hash(w));
+}
+
+// Slot of `w`, whose hash is `hw`: the one holding it, or the empty slot
+// where it would go.
+int32_t Dictionary::find(std::string_view w, uint32_t hw) const {
+  const uint32_t tag = hw & ~SLOT_ID_MASK;
+  int32_t h = hw % MAX_VOCAB_SIZE;
+  while (word2int_[h] != 0 &&
+         ((word2int_[h] & ~SLOT_ID_MASK) != tag || wordAt(slotId(h)) != w)) {
     h = (h + 1) % MAX_VOCAB_SIZE;
   }
   return h;
 }
 
 void Dictionary::add(const std::string& w) {
-  int32_t h = find(w);
+  add(w, hash(w));
+}
+
+void Dictionary::add(const std::string& w, uint32_t hw) {
+  int32_t h = find(w, hw);
   ntokens_++;
-  if (word2int_[h] == -1) {
-    entry e;
-    e.word = w;
-    e.count = 1;
-    e.type = (w.find(args_->label) == 0) ? entry_type::label : entry_type::word;
-    words_.push_back(e);
-    word2int_[h] = size_++;
+  if (word2int_[h] == 0) {
+    addEntry(w, 1, (w.find(args_->label) == 0) ? entry_type::label : entry_type::word);
+    setSlot(h, hw, size_++);
   } else {
-    words_[word2int_[h]].count++;
+    counts_.at(slotId(h))++;
   }
 }
 
+// Appends an entry without subwords; initNgrams builds those for all
+// entries at once.
+void Dictionary::addEntry(std::string_view w, int64_t count, entry_type type) {
+  chars_.append(w.data(), w.data() + w.size());
+  wordOffsets_.push_back(chars_.size());
+  counts_.push_back(count);
+  types_.push_back(type);
+  langs_.push_back(w.back());
+}
+
+void Dictionary::clearEntries() {
+  chars_.clear();
+  wordOffsets_.assign(1, 0);
+  counts_.clear();
+  types_.clear();
+  langs_.clear();
+  subwordOffsets_.assign(1, 0);
+  subwordIds_.clear();
+}
+
+// Keeps the entries listed in `order`, in that order, and drops their
+// subwords. The word table is left for rehash() to rebuild.
+void Dictionary::reorder(const std::vector<int32_t>& order) {
+  std::vector<char> chars;
+  std::vector<int64_t> wordOffsets(1, 0), counts;
+  std::vector<entry_type> types;
+  std::vector<char> langs;
+  counts.reserve(order.size());
+  types.reserve(order.size());
+  langs.reserve(order.size());
+  wordOffsets.reserve(order.size() + 1);
+  for (int32_t i : order) {
+    std::string_view w = wordAt(i);
+    chars.insert(chars.end(), w.begin(), w.end());
+    wordOffsets.push_back(chars.size());
+    counts.push_back(counts_[i]);
+    types.push_back(types_[i]);
+    langs.push_back(langs_[i]);
+  }
+  chars_.swap(chars);
+  wordOffsets_.swap(wordOffsets);
+  counts_.swap(counts);
+  types_.swap(types);
+  langs_.swap(langs);
+  subwordOffsets_.assign(1, 0);
+  subwordIds_.clear();
+}
+
 int32_t Dictionary::nwords() {
   return nwords_;
 }
@@ -74,21 +148,44 @@ int64_t Dictionary::ntokens() {
   return ntokens_;
 }
 
-const std::vector<int32_t>& Dictionary::getNgrams(int32_t i) {
+// Input row of the first subword bucket. Words added by extend() get rows
+// after the buckets, so the bucket rows of a pretrained matrix never move.
+int32_t Dictionary::bucketStart() {
+  return bucketStart_;
+}
+
+int32_t Dictionary::wordRow(int32_t id) {
+  assert(id >= 0);
+  assert(id < nwords_);
+  return id < bucketStart_ ? id : id + args_->bucket;
+}
+
+id_range Dictionary::getNgrams(int32_t i) const {
   assert(i >= 0);
   assert(i < nwords_);
-  return words_[i].subwords;
+  const int32_t* ids = subwordIds_.data();
+  return id_range(ids + subwordOffsets_[i], ids + subwordOffsets_[i + 1]);
 }
 
-const std::vector<int32_t> Dictionary::getNgrams(const std::string& word) {
-  std::vector<int32_t> ngrams;
+// Replaces the contents of `ngrams` with the rows of `word`, in vocabulary
+// or not. Short OOV words are wrapped in BOW/EOW on the stack.
+void Dictionary::getNgrams(std::string_view word, std::vector<int32_t>& ngrams) {
+  ngrams.clear();
   int32_t i = getId(word);
   if (i >= 0) {
-    ngrams = words_[i].subwords;
+    const int32_t* ids = subwordIds_.data();
+    ngrams.assign(ids + subwordOffsets_[i], ids + subwordOffsets_[i + 1]);
+    return;
+  }
+  char buffer[256];
+  if (word.size() + BOW.size() + EOW.size() <= sizeof(buffer)) {
+    char* end = std::copy(BOW.begin(), BOW.end(), buffer);
+    end = std::copy(word.begin(), word.end(), end);
+    end = std::copy(EOW.begin(), EOW.end(), end);
+    computeNgrams(std::string_view(buffer, end - buffer), ngrams);
   } else {
-    computeNgrams(BOW + word + EOW, ngrams);
+    computeNgrams(BOW + std::string(word) + EOW, ngrams);
   }
-  return ngrams;
 }
 
 bool Dictionary::discard(int32_t id, model_name mname, real rand) {
@@ -98,24 +195,37 @@ bool Dictionary::discard(int32_t id, model_name mname, real rand) {
   return rand > pdiscard_[id];
 }
 
-int32_t Dictionary::getId(const std::string& w) {
-  int32_t h = find(w);
-  return word2int_[h];
+int32_t Dictionary::getId(std::string_view w) {
+  return slotId(find(w));
+}
+
+token_info Dictionary::lookup(std::string_view w, uint32_t hw) const {
+  int32_t id = slotId(find(w, hw));
+  if (id < 0) {
+    return token_info{-1, entry_type::word, 0};
+  }
+  return token_info{id, types_[id], langs_[id]};
 }
 
 entry_type Dictionary::getType(int32_t id) {
   assert(id >= 0);
   assert(id < size_);
-  return words_[id].type;
+  return types_[id];
+}
+
+char Dictionary::getLang(int32_t id) {
+  assert(id >= 0);
+  assert(id < size_);
+  return langs_[id];
 }
 
 std::string Dictionary::getWord(int32_t id) {
   assert(id >= 0);
   assert(id < size_);
-  return words_[id].word;
+  return std::string(wordAt(id));
 }
 
-uint32_t Dictionary::hash(const std::string& str) {
+uint32_t Dictionary::hash(std::string_view str) {
   uint32_t h = 2166136261;
   for (size_t i = 0; i < str.size(); i++) {
     h = h ^ uint32_t(str[i]);
@@ -124,29 +234,42 @@ uint32_t Dictionary::hash(const std::string& str) {
   return h;
 }
 
-void Dictionary::computeNgrams(const std::string& word, std::vector<int32_t>& ngrams) {
-  for (size_t i = 0; i < word.size(); i++) {
-    std::string ngram;
-    if ((word[i] & 0xC0) == 0x80) continue;
-    for (size_t j = i, n = 1; j < word.size() && n <= args_->maxn; n++) {
-      ngram.push_back(word[j++]);
-      while (j < word.size() && (word[j] & 0xC0) == 0x80) {
-        ngram.push_back(word[j++]);
-      }
+// Appends the bucket rows of the character n-grams of `word` (already
+// wrapped in BOW/EOW). The FNV hash of each n-gram extends the one of the
+// (n-1)-gram starting at the same character, so every byte is hashed once
+// per start position; ids are those of hash() on the n-gram string.
+void Dictionary::computeNgrams(std::string_view word, std::vector<int32_t>& ngrams) const {
+  const size_t size = word.size();
+  const char* data = word.data();
+  for (size_t i = 0; i < size; i++) {
+    if ((data[i] & 0xC0) == 0x80) continue;
+    uint32_t h = 2166136261;
+    for (size_t j = i, n = 1; j < size && n <= args_->maxn; n++) {
+      do {
+        h = (h ^ uint32_t(data[j++])) * 16777619;
+      } while (j < size && (data[j] & 0xC0) == 0x80);
       if (n >= args_->minn) {
-        int32_t h = hash(ngram) % args_->bucket;
-        ngrams.push_back(nwords_ + h);
+        ngrams.push_back(bucketStart_ + int32_t(h % args_->bucket));
       }
     }
   }
 }
 
 void Dictionary::initNgrams() {
-  for (size_t i = 0; i < size_; i++) {
-    std::string word = BOW + words_[i].word + EOW;
-    words_[i].subwords.push_back(i);
-    computeNgrams(word, words_[i].subwords);
+  profile::Phase phase("dictionary.initNgrams");
+  std::string word;
+  std::vector<int64_t> offsets(1, 0);
+  std::vector<int32_t> ids;
+  offsets.reserve(size_ + 1);
+  for (int32_t i = 0; i < size_; i++) {
+    word.assign(BOW).append(wordAt(i)).append(EOW);
+    ids.push_back(i < nwords_ ? wordRow(i) : i);
+    computeNgrams(word, ids);
+    offsets.push_back(ids.size());
   }
+  ids.shrink_to_fit();
+  subwordOffsets_.swap(offsets);
+  subwordIds_.swap(ids);
 }
 
 bool Dictionary::readWord(std::istream& in, std::string& word)
@@ -172,8 +295,48 @@ bool Dictionary::readWord(std::istream& in, std::string& word)
   return !word.empty();
 }
 
-void Dictionary::readFromFile(std::vector<std::string>& possible_inputs) {
+// readWord on the stream buffer directly, into a reused token, hashing it
+// as it is read so that the lookup does not hash it again.
+bool Dictionary::readToken(std::istream& in, std::string& token, uint32_t& h) const
+{
+  std::streambuf& sb = *in.rdbuf();
+  token.clear();
+  h = 2166136261;
+  while (true) {
+    int next = sb.sgetc();
+    if (next == EOF) {
+      in.setstate(std::ios_base::eofbit);
+      return !token.empty();
+    }
+    char c = next;
+    if (isspace(c) || c == 0) {
+      if (token.empty()) {
+        sb.sbumpc();
+        if (c == '\n') {
+          token = EOS;
+          h = hash(EOS);
+          return true;
+        }
+        continue;
+      }
+      if (c != '\n') sb.sbumpc();
+      return true;
+    }
+    sb.sbumpc();
+    token.push_back(c);
+    h = (h ^ uint32_t(c)) * 16777619;
+  }
+}
+
+// Counts every token of the given corpora into the dictionary, pruning
+// rare words whenever the table gets too full. Returns false if no input
+// was given.
+bool Dictionary::readCorpora(std::vector<std::string>& possible_inputs) {
+  if (args_->sketch > 0) {
+    return readCorporaSketched(possible_inputs);
+  }
   std::string word;
+  uint32_t h;
   int64_t minThreshold = 1;
   bool any_input = false;
   
@@ -181,10 +344,11 @@ void Dictionary::readFromFile(std::vector<std::string>& possible_inputs) {
     if(!possible_input.empty()) {
       any_input = true;
       std::cerr << "Reading data from " << possible_input << std::endl;
-      std::ifstream ifs(possible_input);
+      profile::Phase phase("dictionary.read");
+      InputStream ifs(possible_input);
 
-      while (readWord(ifs, word)) {
-        add(word);
+      while (readToken(ifs, word, h)) {
+        add(word, h);
         if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
           std::cerr << "\rRead " << ntokens_  / 1000000 << "M words" << std::flush;
         }
@@ -197,12 +361,96 @@ void Dictionary::readFromFile(std::vector<std::string>& possible_inputs) {
       std::cerr << std::endl;
     }
   }
-
   if (any_input) {
     std::cerr << "\rRead " << ntokens_  << " words in total" << std::endl;
+  }
+  return any_input;
+}
+
+// Two passes for corpora whose distinct tokens do not fit in the table. The
+// first streams every word through a count-min sketch of -sketch MB and only
+// adds a word to the dictionary once its estimate reaches -minCount; as
+// estimates never undercount, that keeps every word threshold() would keep.
+// The second counts exactly, but only the candidates and the labels, and
+// threshold() then drops the candidates whose estimate was inflated by
+// collisions.
+bool Dictionary::readCorporaSketched(std::vector<std::string>& possible_inputs) {
+  std::string word;
+  uint32_t hw;
+  int64_t minThreshold = 1;
+  int64_t tokens = 0;
+  bool any_input = false;
+  int32_t candidates = size_;
+  {
+    CountMinSketch sketch(int64_t(args_->sketch) << 20);
+    for (auto possible_input : possible_inputs) {
+      if (possible_input.empty()) continue;
+      any_input = true;
+      std::cerr << "Sketching data from " << possible_input << std::endl;
+      profile::Phase phase("dictionary.sketch");
+      InputStream ifs(possible_input);
+      while (readToken(ifs, word, hw)) {
+        tokens++;
+        if (tokens % 1000000 == 0 && args_->verbose > 1) {
+          std::cerr << "\rRead " << tokens / 1000000 << "M words" << std::flush;
+        }
+        if (word.find(args_->label) == 0) continue;
+        int64_t estimate = sketch.add(word);
+        if (estimate < args_->minCount) continue;
+        int32_t h = find(word, hw);
+        if (word2int_[h] == 0) {
+          addEntry(word, 0, entry_type::word);
+          setSlot(h, hw, size_++);
+        }
+        // Entries below frozen_ (a pretrained dictionary being extended)
+        // are counted exactly by the second pass only.
+        if (slotId(h) >= frozen_) {
+          counts_.at(slotId(h)) = estimate;
+        }
+        if (size_ > 0.75 * MAX_VOCAB_SIZE) {
+          threshold(minThreshold++);
+        }
+      }
+      ifs.close();
+      std::cerr << std::endl;
+    }
+  }
+  if (!any_input) return false;
+  candidates = size_ - candidates;
+  for (int32_t i = frozen_; i < size_; i++) {
+    counts_.at(i) = 0;
+  }
+
+  for (auto possible_input : possible_inputs) {
+    if (possible_input.empty()) continue;
+    std::cerr << "Reading data from " << possible_input << std::endl;
+    profile::Phase phase("dictionary.read");
+    InputStream ifs(possible_input);
+    while (readToken(ifs, word, hw)) {
+      if (word2int_[find(word, hw)] != 0 || word.find(args_->label) == 0) {
+        add(word, hw);
+      } else {
+        ntokens_++;
+      }
+      if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
+        std::cerr << "\rRead " << ntokens_  / 1000000 << "M words" << std::flush;
+      }
+    }
+    ifs.close();
+    std::cerr << std::endl;
+  }
+  std::cerr << "\rRead " << ntokens_  << " words in total, "
+            << candidates << " candidate words from the sketch" << std::endl;
+  return true;
+}
+
+void Dictionary::readFromFile(std::vector<std::string>& possible_inputs) {
+  if (readCorpora(possible_inputs)) {
     threshold(args_->minCount);
+    bucketStart_ = nwords_;
     initTableDiscard();
     initNgrams();
+    account();
     std::cerr << "Number of words:  " << nwords_ << std::endl;
     std::cerr << "Number of labels: " << nlabels_ << std::endl;
     if (size_ == 0) {
@@ -212,52 +460,128 @@ void Dictionary::readFromFile(std::vector<std::string>& possible_inputs) {
   }
 }
 
+// Recounts a loaded dictionary on new corpora. Existing entries keep their
+// ids (labels keep their label ids), new words and labels reaching
+// -minCount are appended after them, and ntokens describes the new data
+// only. An existing entry keeps the larger of its new count and its old
+// count scaled to the size of the new data, so that words missing from the
+// new corpora still have their weight in the negative table and a finite
+// discard probability.
+void Dictionary::extend(std::vector<std::string>& possible_inputs) {
+  int32_t nwords = nwords_, nlabels = nlabels_;
+  std::vector<int64_t> counts(counts_.data(), counts_.data() + size_);
+  int64_t ntokens = ntokens_;
+  counts_.assign(size_, 0);
+  subwordOffsets_.assign(1, 0);
+  subwordIds_.clear();
+  ntokens_ = 0;
+  frozen_ = size_;
+  readCorpora(possible_inputs);
+  threshold(args_->minCount);
+  double scale = ntokens > 0 ? double(ntokens_) / double(ntokens) : 0.0;
+  for (int32_t i = 0; i < frozen_; i++) {
+    int64_t carried = std::max(int64_t(1), int64_t(counts[i] * scale + 0.5));
+    counts_.at(i) = std::max(counts_[i], carried);
+  }
+  frozen_ = 0;
+  // [words][labels][new words][new labels] -> [words][new words][labels][new labels]
+  std::vector<int32_t> order(size_);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_partition(order.begin(), order.end(), [&](int32_t i) {
+      return types_[i] == entry_type::word;
+    });
+  reorder(order);
+  rehash();
+  initTableDiscard();
+  initNgrams();
+  account();
+  std::cerr << "Number of words:  " << nwords_ << " (" << nwords_ - nwords << " new)" << std::endl;
+  std::cerr << "Number of labels: " << nlabels_ << " (" << nlabels_ - nlabels << " new)" << std::endl;
+}
+
+// Entries before frozen_ are neither reordered nor pruned.
 void Dictionary::threshold(int64_t t) {
-  sort(words_.begin(), words_.end(), [](const entry& e1, const entry& e2) {
-      if (e1.type != e2.type) return e1.type < e2.type;
-      return e1.count > e2.count;
+  profile::Phase phase("dictionary.threshold");
+  std::vector<int32_t> order(size_);
+  std::iota(order.begin(), order.end(), 0);
+  sort(order.begin() + frozen_, order.end(), [&](int32_t i1, int32_t i2) {
+      if (types_[i1] != types_[i2]) return types_[i1] < types_[i2];
+      return counts_[i1] > counts_[i2];
     });
-  words_.erase(remove_if(words_.begin(), words_.end(), [&](const entry& e) {
-        return e.type == entry_type::word && e.count < t;
-      }), words_.end());
-  words_.shrink_to_fit();
+  order.erase(remove_if(order.begin() + frozen_, order.end(), [&](int32_t i) {
+        return types_[i] == entry_type::word && counts_[i] < t;
+      }), order.end());
+  reorder(order);
+  rehash();
+}
+
+void Dictionary::rehash() {
   size_ = 0;
   nwords_ = 0;
   nlabels_ = 0;
   for (int32_t i = 0; i < MAX_VOCAB_SIZE; i++) {
-    word2int_[i] = -1;
+    word2int_[i] = 0;
   }
-  for (auto it = words_.begin(); it != words_.end(); ++it) {
-    int32_t h = find(it->word);
-    word2int_[h] = size_++;
-    if (it->type == entry_type::word) nwords_++;
-    if (it->type == entry_type::label) nlabels_++;
+  int32_t n = counts_.size();
+  for (int32_t i = 0; i < n; i++) {
+    std::string_view w = wordAt(i);
+    uint32_t hw = hash(w);
+    setSlot(find(w, hw), hw, size_++);
+    if (types_[i] == entry_type::word) nwords_++;
+    if (types_[i] == entry_type::label) nlabels_++;
   }
 }
 
 void Dictionary::initTableDiscard() {
+  profile::Phase phase("dictionary.initTableDiscard");
   pdiscard_.resize(size_);
   for (size_t i = 0; i < size_; i++) {
-    real f = real(words_[i].count) / real(ntokens_);
+    real f = real(counts_[i]) / real(ntokens_);
     pdiscard_[i] = sqrt(args_->t / f) + args_->t / f;
   }
 }
 
 std::vector<int64_t> Dictionary::getCounts(entry_type type) {
   std::vector<int64_t> counts;
-  for (auto& w : words_) {
-    if (w.type == type) counts.push_back(w.count);
+  for (int32_t i = 0; i < size_; i++) {
+    if (types_[i] == type) counts.push_back(counts_[i]);
   }
   return counts;
 }
 
+// Appends the word n-gram buckets of `line` and turns its word ids into
+// input rows.
 void Dictionary::addNgrams(std::vector<int32_t>& line, int32_t n) {
   int32_t line_size = line.size();
   for (int32_t i = 0; i < line_size; i++) {
     uint64_t h = line[i];
     for (int32_t j = i + 1; j < line_size && j < i + n; j++) {
       h = h * 116049371 + line[j];
-      line.push_back(nwords_ + (h % args_->bucket));
+      line.push_back(bucketStart_ + (h % args_->bucket));
+    }
+  }
+  if (bucketStart_ != nwords_) {
+    for (int32_t i = 0; i < line_size; i++) {
+      line[i] = wordRow(line[i]);
+    }
+  }
+}
+
+// The input rows a line of word ids is averaged over outside training: the
+// rows of each word with its subwords, then the word n-grams of the line
+// hashed as addNgrams hashes them.
+void Dictionary::getSentenceRows(const std::vector<int32_t>& words, std::vector<int32_t>& rows) const {
+  rows.clear();
+  for (int32_t w : words) {
+    id_range ngrams = getNgrams(w);
+    rows.insert(rows.end(), ngrams.cbegin(), ngrams.cend());
+  }
+  int32_t n = args_->wordNgrams;
+  for (int32_t i = 0; i < words.size(); i++) {
+    uint64_t h = words[i];
+    for (int32_t j = i + 1; j < words.size() && j < i + n; j++) {
+      h = h * 116049371 + words[j];
+      rows.push_back(bucketStart_ + (h % args_->bucket));
     }
   }
 }
@@ -273,19 +597,20 @@ int32_t Dictionary::getLine(std::istream& in, std::vector<int32_t>& words, std::
     in.clear();
     in.seekg(std::streampos(0));
   }
-  while (readWord(in, token)) {
+  uint32_t h;
+  while (readToken(in, token, h)) {
     if (token == EOS) break;
-    int32_t wid = getId(token);
-    if (wid < 0) continue;
-    entry_type type = getType(wid);
+    token_info t = lookup(token, h);
+    if (t.id < 0) continue;
+    int32_t wid = t.id;
     ntokens++;
-    if (type == entry_type::word) {
+    if (t.type == entry_type::word) {
       real u = uniform(rng);
       if(!discard(wid, mname, u)) {
         words.push_back(wid);
       }
     }
-    if (type == entry_type::label) {
+    if (t.type == entry_type::label) {
       labels.push_back(wid - nwords_);
     }
     if (words.size() > MAX_LINE_SIZE && mname != model_name::sup) {
@@ -305,18 +630,19 @@ int32_t Dictionary::getLine(std::istream& in, std::vector<int32_t>& words, std::
     in.clear();
     in.seekg(std::streampos(0));
   }
-  while (readWord(in, token)) {
+  uint32_t h;
+  while (readToken(in, token, h)) {
     if (token == EOS) break;
-    int32_t wid = getId(token);
-    if (wid < 0) continue;
-    entry_type type = getType(wid);
+    token_info t = lookup(token, h);
+    if (t.id < 0) continue;
+    int32_t wid = t.id;
     ntokens++;
-    if (type == entry_type::word) {
+    if (t.type == entry_type::word) {
       if(!discard(wid, mname, u)) {
         words.push_back(wid);
       }
     }
-    if (type == entry_type::label) {
+    if (t.type == entry_type::label) {
       labels.push_back(wid - nwords_);
     }
     if (words.size() > MAX_LINE_SIZE && mname != model_name::sup) {
@@ -329,7 +655,7 @@ int32_t Dictionary::getLine(std::istream& in, std::vector<int32_t>& words, std::
 std::string Dictionary::getLabel(int32_t lid) {
   assert(lid >= 0);
   assert(lid < nlabels_);
-  return words_[lid + nwords_].word;
+  return std::string(wordAt(lid + nwords_));
 }
 
 void Dictionary::save(std::ostream& out) {
@@ -338,34 +664,192 @@ void Dictionary::save(std::ostream& out) {
   out.write((char*) &nlabels_, sizeof(int32_t));
   out.write((char*) &ntokens_, sizeof(int64_t));
   for (int32_t i = 0; i < size_; i++) {
-    entry e = words_[i];
-    out.write(e.word.data(), e.word.size() * sizeof(char));
+    std::string_view w = wordAt(i);
+    out.write(w.data(), w.size() * sizeof(char));
     out.put(0);
-    out.write((char*) &(e.count), sizeof(int64_t));
-    out.write((char*) &(e.type), sizeof(entry_type));
+    out.write((char*) &(counts_[i]), sizeof(int64_t));
+    out.write((char*) &(types_[i]), sizeof(entry_type));
   }
+  out.write((char*) &bucketStart_, sizeof(int32_t));
 }
 
-void Dictionary::load(std::istream& in) {
-  words_.clear();
+// `version` is the model file format version; version 0 files predate
+// bucketStart and always have their buckets right after the words.
+void Dictionary::load(std::istream& in, int32_t version) {
+  readEntries(in);
+  bucketStart_ = nwords_;
+  if (version >= 1) {
+    in.read((char*) &bucketStart_, sizeof(int32_t));
+  }
+  initTableDiscard();
+  initNgrams();
+  account();
+}
+
+void Dictionary::readEntries(std::istream& in) {
+  clearEntries();
   for (int32_t i = 0; i < MAX_VOCAB_SIZE; i++) {
-    word2int_[i] = -1;
+    word2int_[i] = 0;
   }
   in.read((char*) &size_, sizeof(int32_t));
   in.read((char*) &nwords_, sizeof(int32_t));
   in.read((char*) &nlabels_, sizeof(int32_t));
   in.read((char*) &ntokens_, sizeof(int64_t));
+  std::string word;
   for (int32_t i = 0; i < size_; i++) {
     char c;
-    entry e;
+    int64_t count;
+    entry_type type;
+    word.clear();
     while ((c = in.get()) != 0) {
-      e.word.push_back(c);
+      word.push_back(c);
     }
-    in.read((char*) &e.count, sizeof(int64_t));
-    in.read((char*) &e.type, sizeof(entry_type));
-    words_.push_back(e);
-    word2int_[find(e.word)] = i;
+    in.read((char*) &count, sizeof(int64_t));
+    in.read((char*) &type, sizeof(entry_type));
+    addEntry(word, count, type);
+    uint32_t hw = hash(word);
+    setSlot(find(word, hw), hw, i);
+  }
+}
+
+// Standalone dictionary written by `build-dict`: a header followed by the
+// entry arrays exactly as they are laid out in memory, each aligned to
+// DICT_ALIGN bytes, so that loadFromFile maps the file and uses the arrays
+// in place. Counts are kept to rebuild the discard table; the subword rows
+// mean loading needs neither the corpora nor computeNgrams.
+//
+//   int32 magic, version, bucket, minn, maxn, minCount
+//   int32 size, nwords, nlabels, bucketStart; int64 ntokens
+//   7 x {int64 offset, int64 length} for chars, wordOffsets, counts,
+//     types, langs, subwordOffsets, subwordIds
+//   the arrays
+void Dictionary::saveToFile(const std::string& filename) {
+  std::ofstream out(filename, std::ofstream::binary);
+  if (!out.is_open()) {
+    std::cerr << "Dictionary file cannot be opened for saving!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::vector<std::pair<const char*, int64_t>> sections = {
+    {(const char*) chars_.data(), int64_t(chars_.size())},
+    {(const char*) wordOffsets_.data(), int64_t(wordOffsets_.size() * sizeof(int64_t))},
+    {(const char*) counts_.data(), int64_t(counts_.size() * sizeof(int64_t))},
+    {(const char*) types_.data(), int64_t(types_.size() * sizeof(entry_type))},
+    {(const char*) langs_.data(), int64_t(langs_.size())},
+    {(const char*) subwordOffsets_.data(), int64_t(subwordOffsets_.size() * sizeof(int64_t))},
+    {(const char*) subwordIds_.data(), int64_t(subwordIds_.size() * sizeof(int32_t))},
+  };
+  int32_t magic = DICT_MAGIC, version = DICT_VERSION;
+  out.write((char*) &magic, sizeof(int32_t));
+  out.write((char*) &version, sizeof(int32_t));
+  out.write((char*) &(args_->bucket), sizeof(int));
+  out.write((char*) &(args_->minn), sizeof(int));
+  out.write((char*) &(args_->maxn), sizeof(int));
+  out.write((char*) &(args_->minCount), sizeof(int));
+  out.write((char*) &size_, sizeof(int32_t));
+  out.write((char*) &nwords_, sizeof(int32_t));
+  out.write((char*) &nlabels_, sizeof(int32_t));
+  out.write((char*) &bucketStart_, sizeof(int32_t));
+  out.write((char*) &ntokens_, sizeof(int64_t));
+
+  int64_t pos = 10 * sizeof(int32_t) + sizeof(int64_t) + sections.size() * 2 * sizeof(int64_t);
+  for (auto& section : sections) {
+    int64_t offset = (pos + DICT_ALIGN - 1) / DICT_ALIGN * DICT_ALIGN;
+    out.write((char*) &offset, sizeof(int64_t));
+    out.write((char*) &section.second, sizeof(int64_t));
+    pos = offset + section.second;
   }
+  pos = out.tellp();
+  const char zeros[DICT_ALIGN] = {0};
+  for (auto& section : sections) {
+    int64_t offset = (pos + DICT_ALIGN - 1) / DICT_ALIGN * DICT_ALIGN;
+    out.write(zeros, offset - pos);
+    out.write(section.first, section.second);
+    pos = offset + section.second;
+  }
+  out.close();
+  if (!out) {
+    std::cerr << "Dictionary could not be written to " << filename << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void Dictionary::loadFromFile(const std::string& filename) {
+  profile::Phase phase("dictionary.loadFromFile");
+  std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+  if (!file->open(filename)) {
+    std::cerr << "Dictionary file cannot be opened for loading!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const int64_t headerSize = 10 * sizeof(int32_t) + sizeof(int64_t) + 14 * sizeof(int64_t);
+  int32_t header[10];
+  int64_t sections[14];
+  if (file->size() < headerSize) {
+    std::cerr << filename << " is not a dictionary file this binary can read." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  memcpy(header, file->data(), 10 * sizeof(int32_t));
+  memcpy(&ntokens_, file->data() + 10 * sizeof(int32_t), sizeof(int64_t));
+  memcpy(sections, file->data() + 10 * sizeof(int32_t) + sizeof(int64_t), sizeof(sections));
+  int32_t magic = header[0], version = header[1];
+  int bucket = header[2], minn = header[3], maxn = header[4], minCount = header[5];
+  if (magic != DICT_MAGIC || version != DICT_VERSION) {
+    std::cerr << filename << " is not a dictionary file this binary can read." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (bucket != args_->bucket || minn != args_->minn || maxn != args_->maxn) {
+    std::cerr << filename << " was built with -bucket " << bucket << " -minn " << minn
+              << " -maxn " << maxn << "; train with the same values." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (minCount != args_->minCount) {
+    std::cerr << "Warning: " << filename << " was thresholded with -minCount "
+              << minCount << std::endl;
+  }
+  int32_t size = header[6];
+  nwords_ = header[7];
+  nlabels_ = header[8];
+  bucketStart_ = header[9];
+
+  const char* base = file->data();
+  bool valid = size >= 0;
+  for (int32_t i = 0; i < 7; i++) {
+    int64_t offset = sections[2 * i], length = sections[2 * i + 1];
+    valid = valid && offset >= headerSize && offset % DICT_ALIGN == 0 && length >= 0 &&
+            offset + length <= int64_t(file->size());
+  }
+  valid = valid && sections[3] == (size + 1) * int64_t(sizeof(int64_t)) &&
+          sections[5] == size * int64_t(sizeof(int64_t)) &&
+          sections[7] == size * int64_t(sizeof(entry_type)) &&
+          sections[9] == size &&
+          sections[11] == (size + 1) * int64_t(sizeof(int64_t));
+  if (!valid) {
+    std::cerr << "Dictionary file " << filename << " is truncated." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  chars_.view(file, base + sections[0], sections[1]);
+  wordOffsets_.view(file, (const int64_t*) (base + sections[2]), size + 1);
+  counts_.view(file, (const int64_t*) (base + sections[4]), size);
+  types_.view(file, (const entry_type*) (base + sections[6]), size);
+  langs_.view(file, base + sections[8], size);
+  subwordOffsets_.view(file, (const int64_t*) (base + sections[10]), size + 1);
+  subwordIds_.view(file, (const int32_t*) (base + sections[12]), sections[13] / sizeof(int32_t));
+  if (wordOffsets_[size] != int64_t(chars_.size()) ||
+      subwordOffsets_[size] != int64_t(subwordIds_.size())) {
+    std::cerr << "Dictionary file " << filename << " is truncated." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  mappedAccount_.set(file->size());
+  rehash();
   initTableDiscard();
-  initNgrams();
+  account();
+  std::cerr << "Number of words:  " << nwords_ << std::endl;
+  std::cerr << "Number of labels: " << nlabels_ << std::endl;
+}
+
+void Dictionary::account() {
+  word2intAccount_.set(word2int_.capacity() * sizeof(uint32_t));
+  wordsAccount_.set(chars_.bytes() + wordOffsets_.bytes() + counts_.bytes() +
+                    types_.bytes() + langs_.bytes());
+  subwordsAccount_.set(subwordOffsets_.bytes() + subwordIds_.bytes());
+  pdiscardAccount_.set(pdiscard_.capacity() * sizeof(real));
 }
@@ -12,42 +12,112 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <istream>
 #include <ostream>
 #include <random>
 #include <memory>
 
 #include "args.h"
+#include "flat.h"
+#include "profile.h"
 #include "real.h"
 
 typedef int32_t id_type;
 enum class entry_type : int8_t {word=0, label=1};
 
-struct entry {
-  std::string word;
-  int64_t count;
+// Read-only run of ids, such as the subword rows of one entry.
+struct id_range {
+  const int32_t* first;
+  const int32_t* last;
+
+  id_range(const int32_t* f, const int32_t* l) : first(f), last(l) {}
+  id_range(const std::vector<int32_t>& v) : first(v.data()), last(v.data() + v.size()) {}
+  inline const int32_t* begin() const { return first; }
+  inline const int32_t* end() const { return last; }
+  inline const int32_t* cbegin() const { return first; }
+  inline const int32_t* cend() const { return last; }
+  inline size_t size() const { return last - first; }
+};
+
+// What one probe of the word table knows about a token. `lang` is the
+// language tag, the last character of the word (`_s`/`_t` suffixes).
+struct token_info {
+  int32_t id;
   entry_type type;
-  std::vector<int32_t> subwords;
+  char lang;
 };
 
 class Dictionary {
   private:
     static const int32_t MAX_VOCAB_SIZE = 30000000;
     static const int32_t MAX_LINE_SIZE = 1024;
+    static const int32_t DICT_MAGIC = 0x54434944;
+    static const int32_t DICT_VERSION = 2;
+    static const int32_t DICT_ALIGN = 64;
+
+    // A word2int_ slot holds id + 1 (0 when empty) under the top bits of
+    // the word's hash, which probes compare before the strings.
+    static const int32_t SLOT_ID_BITS = 25;
+    static const uint32_t SLOT_ID_MASK = (1u << SLOT_ID_BITS) - 1;
+
+    int32_t find(std::string_view) const;
+    int32_t find(std::string_view, uint32_t) const;
+    bool readToken(std::istream&, std::string&, uint32_t&) const;
+    void add(const std::string&, uint32_t);
 
-    int32_t find(const std::string&);
+    inline int32_t slotId(int32_t h) const {
+      return int32_t(word2int_[h] & SLOT_ID_MASK) - 1;
+    }
+    inline void setSlot(int32_t h, uint32_t hash, int32_t id) {
+      word2int_[h] = (hash & ~SLOT_ID_MASK) | uint32_t(id + 1);
+    }
+    inline std::string_view wordAt(int32_t i) const {
+      return std::string_view(chars_.data() + wordOffsets_[i], wordOffsets_[i + 1] - wordOffsets_[i]);
+    }
+    void addEntry(std::string_view, int64_t, entry_type);
+    void reorder(const std::vector<int32_t>&);
+    void clearEntries();
     void initTableDiscard();
     void initNgrams();
     void threshold(int64_t);
+    void rehash();
+    void account();
+    bool readCorpora(std::vector<std::string>&);
+    bool readCorporaSketched(std::vector<std::string>&);
+    void readEntries(std::istream&);
     
     std::shared_ptr<Args> args_;
-    std::vector<int32_t> word2int_;
-    std::vector<entry> words_;
+    std::vector<uint32_t> word2int_;
     std::vector<real> pdiscard_;
+
+    // The entries, as structure of arrays: entry i is the word
+    // chars_[wordOffsets_[i], wordOffsets_[i + 1]) with its count, type and
+    // language tag, and its input rows are
+    // subwordIds_[subwordOffsets_[i], subwordOffsets_[i + 1]). The arrays
+    // view the mapped file after loadFromFile.
+    FlatArray<char> chars_;
+    FlatArray<int64_t> wordOffsets_;
+    FlatArray<int64_t> counts_;
+    FlatArray<entry_type> types_;
+    FlatArray<char> langs_;
+    FlatArray<int64_t> subwordOffsets_;
+    FlatArray<int32_t> subwordIds_;
+
     int32_t size_;
     int32_t nwords_;
     int32_t nlabels_;
     int64_t ntokens_;
+    int32_t bucketStart_;
+    int32_t frozen_;
+
+    profile::Account word2intAccount_;
+    profile::Account wordsAccount_;
+    profile::Account subwordsAccount_;
+    profile::Account pdiscardAccount_;
+    profile::Account mappedAccount_;
+
+    friend class Corpus;
 
   public:
     static const std::string EOS;
@@ -58,22 +128,34 @@ class Dictionary {
     int32_t nwords();
     int32_t nlabels();
     int64_t ntokens();
-    int32_t getId(const std::string&);
+    int32_t bucketStart();
+    int32_t wordRow(int32_t);
+    int32_t getId(std::string_view);
+    token_info lookup(std::string_view, uint32_t) const;
     entry_type getType(int32_t);
+    char getLang(int32_t);
     bool discard(int32_t, model_name mname, real);
     std::string getWord(int32_t);
-    const std::vector<int32_t>& getNgrams(int32_t);
-    const std::vector<int32_t> getNgrams(const std::string&);
-    void computeNgrams(const std::string&, std::vector<int32_t>&);
-    uint32_t hash(const std::string& str);
+    // Word or label `id` (labels come after the words), without a copy.
+    inline std::string_view getEntry(int32_t id) const {
+      return wordAt(id);
+    }
+    id_range getNgrams(int32_t) const;
+    void getNgrams(std::string_view, std::vector<int32_t>&);
+    void computeNgrams(std::string_view, std::vector<int32_t>&) const;
+    static uint32_t hash(std::string_view);
     void add(const std::string&);
     bool readWord(std::istream&, std::string&);
     void readFromFile(std::vector<std::string>&);
+    void extend(std::vector<std::string>&);
+    void saveToFile(const std::string&);
+    void loadFromFile(const std::string&);
     std::string getLabel(int32_t);
     void save(std::ostream&);
-    void load(std::istream&);
+    void load(std::istream&, int32_t);
     std::vector<int64_t> getCounts(entry_type);
     void addNgrams(std::vector<int32_t>&, int32_t);
+    void getSentenceRows(const std::vector<int32_t>&, std::vector<int32_t>&) const;
     int32_t getLine(std::istream&, std::vector<int32_t>&, std::vector<int32_t>&, model_name mname, std::minstd_rand&);
     int32_t getLine(std::istream&, std::vector<int32_t>&, std::vector<int32_t>&, model_name mname, real);
 };
@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "dist.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <unordered_map>
+
+#include "profile.h"
+
+namespace {
+
+  void fail(const std::string& what) {
+    std::cerr << what << ": " << strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  void writeAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*) data;
+    while (size > 0) {
+      ssize_t n = write(fd, p, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) fail("Lost connection while sending");
+      p += n;
+      size -= n;
+    }
+  }
+
+  void readAll(int fd, void* data, size_t size) {
+    char* p = (char*) data;
+    while (size > 0) {
+      ssize_t n = read(fd, p, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n == 0) errno = ECONNRESET;
+      if (n <= 0) fail("Lost connection while receiving");
+      p += n;
+      size -= n;
+    }
+  }
+
+  sockaddr_un address(const std::string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Socket path " << path << " is too long; use a shorter -output." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+  }
+
+  // Rows to send: (row, values) packed as in the wire format.
+  void sendRows(int fd, const Matrix& m, const std::vector<int64_t>& rows) {
+    int64_t count = rows.size();
+    writeAll(fd, &count, sizeof(int64_t));
+    for (int64_t row : rows) {
+      writeAll(fd, &row, sizeof(int64_t));
+      writeAll(fd, m.data_ + row * m.stride_, m.n_ * sizeof(real));
+    }
+  }
+}
+
+Coordinator::Coordinator(std::shared_ptr<Args> args, std::vector<std::shared_ptr<Matrix>> matrices) {
+  args_ = args;
+  matrices_ = matrices;
+  path_ = args->output + ".sock";
+  rounds_ = 0;
+  sockaddr_un addr = address(path_);
+  unlink(path_.c_str());
+  listen_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_ < 0) fail("Cannot create socket");
+  if (bind(listen_, (sockaddr*) &addr, sizeof(addr)) < 0) fail("Cannot bind " + path_);
+  if (listen(listen_, args->workers) < 0) fail("Cannot listen on " + path_);
+}
+
+Coordinator::~Coordinator() {
+  for (int fd : workers_) {
+    close(fd);
+  }
+  close(listen_);
+  unlink(path_.c_str());
+}
+
+const std::string& Coordinator::path() const {
+  return path_;
+}
+
+// Waits for one connection per process in `pids`, checking between polls
+// that none of them exited before connecting, e.g. on bad input or OOM.
+void Coordinator::accept(const std::vector<pid_t>& pids) {
+  while (workers_.size() < pids.size()) {
+    pollfd pfd;
+    pfd.fd = listen_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, 1000);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready < 0) fail("Cannot poll " + path_);
+    if (ready > 0) {
+      int fd = ::accept(listen_, nullptr, nullptr);
+      if (fd < 0 && errno == EINTR) continue;
+      if (fd < 0) fail("Cannot accept worker");
+      workers_.push_back(fd);
+      continue;
+    }
+    for (pid_t pid : pids) {
+      int status;
+      if (waitpid(pid, &status, WNOHANG) == pid) {
+        std::cerr << "Worker process " << pid << " exited before connecting";
+        if (WIFEXITED(status)) {
+          std::cerr << " (status " << WEXITSTATUS(status) << ")";
+        } else if (WIFSIGNALED(status)) {
+          std::cerr << " (signal " << WTERMSIG(status) << ")";
+        }
+        std::cerr << "." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+}
+
+void Coordinator::serve() {
+  profile::Phase phase("dist.serve");
+  while (!workers_.empty()) {
+    round();
+  }
+  if (args_->verbose > 2) {
+    std::cerr << "Coordinator ran " << rounds_ << " rounds" << std::endl;
+  }
+}
+
+// Reads one message from every worker still training, averages the rows
+// any of them touched and answers those that are not done. Messages are
+// consumed matrix by matrix across workers; each worker has its own
+// stream, and workers only wait for the answer once their whole message
+// is written, so this cannot deadlock.
+void Coordinator::round() {
+  const int32_t participants = workers_.size();
+  std::vector<bool> done(participants);
+  std::vector<std::vector<int64_t>> unions(matrices_.size());
+  for (size_t k = 0; k < matrices_.size(); k++) {
+    Matrix& m = *matrices_[k];
+    std::unordered_map<int64_t, size_t> index;
+    std::vector<real> sums;
+    std::vector<int32_t> touched;
+    std::vector<real> row(m.n_);
+    for (int32_t w = 0; w < participants; w++) {
+      if (k == 0) {
+        int32_t flag;
+        readAll(workers_[w], &flag, sizeof(int32_t));
+        done[w] = flag != 0;
+      }
+      int64_t count;
+      readAll(workers_[w], &count, sizeof(int64_t));
+      for (int64_t i = 0; i < count; i++) {
+        int64_t r;
+        readAll(workers_[w], &r, sizeof(int64_t));
+        readAll(workers_[w], row.data(), m.n_ * sizeof(real));
+        auto it = index.find(r);
+        if (it == index.end()) {
+          it = index.insert(std::make_pair(r, unions[k].size())).first;
+          unions[k].push_back(r);
+          sums.resize(sums.size() + m.n_, 0.0);
+          touched.push_back(0);
+        }
+        real* sum = sums.data() + it->second * m.n_;
+        for (int64_t j = 0; j < m.n_; j++) {
+          sum[j] += row[j];
+        }
+        touched[it->second]++;
+      }
+    }
+    for (size_t u = 0; u < unions[k].size(); u++) {
+      real* global = m.data_ + unions[k][u] * m.stride_;
+      const real* sum = sums.data() + u * m.n_;
+      const real untouched = participants - touched[u];
+      for (int64_t j = 0; j < m.n_; j++) {
+        global[j] = (sum[j] + untouched * global[j]) / participants;
+      }
+    }
+  }
+  std::vector<int> active;
+  for (int32_t w = 0; w < participants; w++) {
+    if (done[w]) {
+      close(workers_[w]);
+      continue;
+    }
+    for (size_t k = 0; k < matrices_.size(); k++) {
+      sendRows(workers_[w], *matrices_[k], unions[k]);
+    }
+    active.push_back(workers_[w]);
+  }
+  workers_ = active;
+  rounds_++;
+}
+
+Worker::Worker(std::shared_ptr<Args> args, const std::string& path,
+               std::vector<std::shared_ptr<Matrix>> matrices) {
+  matrices_ = matrices;
+  interval_ = args->syncTokens;
+  tokens_ = 0;
+  next_ = interval_;
+  for (auto& m : matrices_) {
+    m->dirty_.assign(m->m_, 0);
+  }
+  sockaddr_un addr = address(path);
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ < 0) fail("Cannot create socket");
+  if (connect(fd_, (sockaddr*) &addr, sizeof(addr)) < 0) fail("Cannot connect to " + path);
+}
+
+Worker::~Worker() {
+  close(fd_);
+}
+
+void Worker::step(int64_t ntokens) {
+  tokens_ += ntokens;
+  if (tokens_ >= next_) {
+    next_ = tokens_ + interval_;
+    sync(false);
+  }
+}
+
+void Worker::finish() {
+  sync(true);
+}
+
+void Worker::sync(bool done) {
+  profile::Phase phase("dist.sync");
+  int32_t flag = done;
+  writeAll(fd_, &flag, sizeof(int32_t));
+  for (auto& m : matrices_) {
+    std::vector<int64_t> rows;
+    for (int64_t i = 0; i < m->m_; i++) {
+      if (m->dirty_[i]) {
+        rows.push_back(i);
+        m->dirty_[i] = 0;
+      }
+    }
+    sendRows(fd_, *m, rows);
+  }
+  if (done) return;
+  for (auto& m : matrices_) {
+    int64_t count;
+    readAll(fd_, &count, sizeof(int64_t));
+    for (int64_t i = 0; i < count; i++) {
+      int64_t row;
+      readAll(fd_, &row, sizeof(int64_t));
+      readAll(fd_, m->data_ + row * m->stride_, m->n_ * sizeof(real));
+    }
+  }
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_DIST_H
+#define FASTTEXT_DIST_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "args.h"
+#include "matrix.h"
+
+// Data-parallel training over a local socket. Every worker process trains
+// its shard of the corpora on a private copy of the matrices and, every
+// -syncTokens tokens, sends the rows it touched since the last round to
+// the coordinator. The coordinator averages each such row over the
+// round's workers (counting the workers that did not touch it with the
+// previous value, i.e. plain model averaging restricted to the rows that
+// moved) and sends the averaged rows back. Rounds are synchronous, so
+// outside a round all workers hold the coordinator's matrices.
+//
+// Wire format, all integers and reals in host order:
+//   worker -> coordinator: int32 done, then per matrix: int64 nrows and
+//                          nrows x (int64 row, n reals)
+//   coordinator -> worker: per matrix: int64 nrows and nrows x (int64 row, n reals)
+class Coordinator {
+  private:
+    std::shared_ptr<Args> args_;
+    std::vector<std::shared_ptr<Matrix>> matrices_;
+    std::string path_;
+    int listen_;
+    std::vector<int> workers_;
+    int64_t rounds_;
+
+    void round();
+
+  public:
+    Coordinator(std::shared_ptr<Args>, std::vector<std::shared_ptr<Matrix>>);
+    ~Coordinator();
+
+    const std::string& path() const;
+    void accept(const std::vector<pid_t>&);
+    void serve();
+};
+
+class Worker {
+  private:
+    std::vector<std::shared_ptr<Matrix>> matrices_;
+    int fd_;
+    int64_t interval_;
+    int64_t tokens_;
+    int64_t next_;
+
+    void sync(bool);
+
+  public:
+    Worker(std::shared_ptr<Args>, const std::string&, std::vector<std::shared_ptr<Matrix>>);
+    ~Worker();
+
+    void step(int64_t);
+    void finish();
+};
+
+#endif
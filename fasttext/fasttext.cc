@@ -12,15 +12,26 @@
 #include <fenv.h>
 #include <math.h>
 #include <assert.h>
-#include <time.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <thread>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <limits>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "alloc.h"
+#include "sweep.h"
+#include "validation.h"
 
 
 void printUsage() {
@@ -28,10 +39,14 @@ void printUsage() {
   << "usage: fasttext <command> <args>\n\n"
   << "The commands supported by fasttext are:\n\n"
   << "  bilingual        train a bilingual classifier (experimental)\n"
+  << "  build-dict       count the input once and save the vocabulary to <output>.dict\n"
+  << "  sweep            train bilingual-s over a grid or random search of options, scored on -valid\n"
   << "  test             evaluate a supervised classifier\n"
   << "  predict          predict most likely labels\n"
   << "  predict-prob     predict most likely labels with probabilities\n"
   << "  print-vectors    print vectors given a trained model\n"
+  << "  print-sentence-vectors\n"
+  << "                   print one vector per line of a file given a trained model\n"
   << std::endl;
 }
 
@@ -60,6 +75,16 @@ void printPrintVectorsUsage() {
   << std::endl;
 }
 
+void printPrintSentenceVectorsUsage() {
+  std::cout
+  << "usage: fasttext print-sentence-vectors <model> <text> [<threads>] [<output>]\n\n"
+  << "  <model>      model filename\n"
+  << "  <text>       text filename, - for stdin\n"
+  << "  <threads>    (optional; 1 by default) number of threads\n"
+  << "  <output>     (optional) write the vectors to this file as a binary matrix instead of printing them\n"
+  << std::endl;
+}
+
 void test(int argc, char** argv) {
   int32_t k;
   if (argc == 4) {
@@ -101,8 +126,24 @@ void printVectors(int argc, char** argv) {
   exit(0);
 }
 
+void printSentenceVectors(int argc, char** argv) {
+  if (argc < 4 || argc > 6) {
+    printPrintSentenceVectorsUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t threads = argc > 4 ? atoi(argv[4]) : 1;
+  if (threads < 1) {
+    printPrintSentenceVectorsUsage();
+    exit(EXIT_FAILURE);
+  }
+  FastText ft{std::string(argv[2])};
+  ft.printSentenceVectors(std::string(argv[3]), argc > 5 ? std::string(argv[5]) : "", threads);
+  exit(0);
+}
+
 void FastText::getVector(Vector& vec, const std::string& word) {
-  const std::vector<int32_t>& ngrams = dict_->getNgrams(word);
+  std::vector<int32_t>& ngrams = ngramsBuffer_;
+  dict_->getNgrams(word, ngrams);
   vec.zero();
   for (auto it = ngrams.begin(); it != ngrams.end(); ++it) {
     vec.addRow(*input_, *it);
@@ -137,19 +178,217 @@ void FastText::printVectors() {
   }
 }
 
+// The vector of a line of word ids, averaged like Model::computeHidden
+// averages the input of an example: over the rows of its words, subwords
+// included, and of its word n-grams. Zero for an empty line.
+void FastText::getSentenceVector(Vector& vec, const std::vector<int32_t>& words) {
+  std::vector<int32_t>& rows = ngramsBuffer_;
+  dict_->getSentenceRows(words, rows);
+  vec.zero();
+  for (int32_t row : rows) {
+    vec.addRow(*input_, row);
+  }
+  if (rows.size() > 0) {
+    vec.mul(1.0 / rows.size());
+  }
+}
+
+// Appends the vectors of the lines of `block`, which ends with a newline,
+// to `vectors`, and returns the number of lines. Labels and words out of
+// the vocabulary are left out, and nothing is subsampled.
+int64_t FastText::embedLines(const std::string& block, std::vector<real>& vectors) {
+  std::istringstream in(block);
+  std::vector<int32_t> words, labels;
+  Vector vec(args_->dim);
+  int64_t nlines = std::count(block.begin(), block.end(), '\n');
+  for (int64_t i = 0; i < nlines; i++) {
+    dict_->getLine(in, words, labels, model_name::sup, 0.0);
+    getSentenceVector(vec, words);
+    vectors.insert(vectors.end(), vec.data_, vec.data_ + vec.m_);
+  }
+  return nlines;
+}
+
+// Reads whole lines of `in` into `block`, about SENTENCE_BLOCK bytes of
+// them, and keeps the start of the next line in `carry`. The last line of
+// the input gets a newline if it has none. Returns false at the end.
+static const size_t SENTENCE_BLOCK = 1 << 20;
+
+static bool readLines(std::istream& in, std::string& carry, std::string& block) {
+  block.swap(carry);
+  carry.clear();
+  while (true) {
+    size_t start = block.size();
+    block.resize(start + SENTENCE_BLOCK);
+    in.read(&block[start], SENTENCE_BLOCK);
+    block.resize(start + in.gcount());
+    if (size_t(in.gcount()) < SENTENCE_BLOCK) {
+      if (!block.empty() && block.back() != '\n') block.push_back('\n');
+      return !block.empty();
+    }
+    size_t end = block.rfind('\n');
+    if (end != std::string::npos) {
+      carry.assign(block, end + 1, std::string::npos);
+      block.resize(end + 1);
+      return true;
+    }
+  }
+}
+
+// Prints `n` vectors the way operator<< prints a Vector, one per line.
+static void formatVectors(const std::vector<real>& vectors, int64_t n, std::string& out) {
+  char buffer[32];
+  out.clear();
+  for (size_t i = 0; i < vectors.size(); i++) {
+    int len = snprintf(buffer, sizeof(buffer), "%.5g ", vectors[i]);
+    out.append(buffer, len);
+    if ((i + 1) % n == 0) out.push_back('\n');
+  }
+}
+
+// One vector per line of `filename` (- for stdin), printed, or saved to
+// `output` as a Matrix when it is given. The input is cut into blocks of
+// lines that `threads` threads embed while the next blocks are read, and
+// the results are written in the order of the input. The threads live for
+// the whole file: each round, the reader publishes the blocks and bumps
+// `round`, and waits for the `pending` active workers before writing.
+void FastText::printSentenceVectors(const std::string& filename, const std::string& output,
+                                    int32_t threads) {
+  std::unique_ptr<InputStream> file;
+  if (filename != "-") {
+    file.reset(new InputStream(filename));
+    if (!file->is_open()) {
+      std::cerr << "Input file cannot be opened!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::istream& in = file ? *file : std::cin;
+  std::ofstream ofs;
+  int64_t nlines = 0, dim = args_->dim;
+  if (!output.empty()) {
+    ofs.open(output, std::ofstream::binary);
+    if (!ofs.is_open()) {
+      std::cerr << "Output file cannot be opened for saving!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    ofs.write((char*) &nlines, sizeof(int64_t));
+    ofs.write((char*) &dim, sizeof(int64_t));
+  }
+  
+  // One FastText per thread for the buffers of getSentenceVector.
+  std::vector<std::unique_ptr<FastText>> embedders;
+  for (int32_t i = 0; i < threads; i++) {
+    embedders.emplace_back(new FastText(args_, dict_, input_, output_));
+  }
+  std::vector<std::string> blocks(threads), next(threads), texts(threads);
+  std::vector<std::vector<real>> vectors(threads);
+  std::string carry;
+  int32_t nblocks = 0;
+  while (nblocks < threads && readLines(in, carry, blocks[nblocks])) nblocks++;
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  int64_t round = 0;
+  int32_t active = 0, pending = 0;
+  bool stop = false;
+  std::vector<std::thread> workers;
+  for (int32_t i = 0; i < threads; i++) {
+    workers.push_back(std::thread([&, i]() {
+      int64_t seen = 0;
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          started.wait(lock, [&]() { return stop || round > seen; });
+          if (stop) return;
+          seen = round;
+          if (i >= active) continue;
+        }
+        vectors[i].clear();
+        embedders[i]->embedLines(blocks[i], vectors[i]);
+        if (output.empty()) formatVectors(vectors[i], dim, texts[i]);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) finished.notify_one();
+      }
+    }));
+  }
+  while (nblocks > 0) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      active = pending = nblocks;
+      round++;
+    }
+    started.notify_all();
+    int32_t nnext = 0;
+    while (nnext < threads && readLines(in, carry, next[nnext])) nnext++;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&]() { return pending == 0; });
+    }
+    for (int32_t i = 0; i < nblocks; i++) {
+      if (output.empty()) {
+        std::cout << texts[i];
+      } else {
+        ofs.write((char*) vectors[i].data(), vectors[i].size() * sizeof(real));
+      }
+      nlines += vectors[i].size() / dim;
+    }
+    blocks.swap(next);
+    nblocks = nnext;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  started.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  std::cout.flush();
+  if (ofs.is_open()) {
+    ofs.seekp(0);
+    ofs.write((char*) &nlines, sizeof(int64_t));
+    ofs.close();
+  }
+}
+
 void FastText::saveModel(std::string suffix) {
   std::ofstream ofs(args_->output + suffix + ".bin", std::ofstream::binary);
   if (!ofs.is_open()) {
     std::cerr << "Model file cannot be opened for saving!" << std::endl;
     exit(EXIT_FAILURE);
   }
+  const int32_t magic = FASTTEXT_FILEFORMAT_MAGIC_INT32;
+  const int32_t version = FASTTEXT_VERSION;
+  ofs.write((char*) &magic, sizeof(int32_t));
+  ofs.write((char*) &version, sizeof(int32_t));
   args_->save(ofs);
   dict_->save(ofs);
+  Matrix::savePadding(ofs);
   input_->save(ofs);
+  Matrix::savePadding(ofs);
   output_->save(ofs);
   ofs.close();
 }
 
+// Returns the format version of a model file and leaves the stream at the
+// stored Args. Files written before the header existed start with the Args
+// directly and are version 0.
+int32_t readModelHeader(std::istream& in) {
+  int32_t magic, version;
+  in.read((char*) &magic, sizeof(int32_t));
+  if (magic != FASTTEXT_FILEFORMAT_MAGIC_INT32) {
+    in.clear();
+    in.seekg(0);
+    return 0;
+  }
+  in.read((char*) &version, sizeof(int32_t));
+  if (version > FASTTEXT_VERSION) {
+    std::cerr << "Model file has version " << version << ", this binary reads up to "
+              << FASTTEXT_VERSION << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return version;
+}
+
 FastText::FastText(const std::string& filename) {
   std::ifstream ifs(filename, std::ifstream::binary);
   if (!ifs.is_open()) {
@@ -161,9 +400,12 @@ FastText::FastText(const std::string& filename) {
   input_ = std::make_shared<Matrix>();
   output_ = std::make_shared<Matrix>();
   
+  int32_t version = readModelHeader(ifs);
   args_->load(ifs);
-  dict_->load(ifs);
+  dict_->load(ifs, version);
+  if (version >= 2) Matrix::skipPadding(ifs);
   input_->load(ifs);
+  if (version >= 2) Matrix::skipPadding(ifs);
   output_->load(ifs);
   
   model_ = std::make_shared<Model>(input_, output_, args_, 0);
@@ -176,29 +418,11 @@ FastText::FastText(const std::string& filename) {
   ifs.close();
 }
 
-void FastText::printInfo(real progress, real loss) {
-  real t = real(clock() - start) / CLOCKS_PER_SEC;
-  real wst = real(tokenCount) / t;
-  real lr = args_->lr * (1.0 - progress);
-  int eta = int(t / progress * (1 - progress) / args_->thread);
-  int etah = eta / 3600;
-  int etam = (eta - etah * 3600) / 60;
-  std::cerr << std::fixed;
-  std::cerr << "\rProgress: " << std::setprecision(1) << 100 * progress << "%";
-  std::cerr << "  words/sec/thread: " << std::setprecision(0) << wst;
-  std::cerr << "  lr: " << std::setprecision(6) << lr;
-  std::cerr << "  loss: " << std::setprecision(6) << loss;
-  std::cerr << "  eta: " << etah << "h" << etam << "m ";
-  std::cerr << std::flush;
-  
-  std::cout << args_->name << "|" << progress << "|" << lr << "|" << loss << std::endl;
-}
-
 void FastText::test(const std::string& filename, int32_t k) {
   int32_t nexamples = 0, nlabels = 0;
   double precision = 0.0;
   std::vector<int32_t> line, labels;
-  std::ifstream ifs(filename);
+  InputStream ifs(filename);
   if (!ifs.is_open()) {
     std::cerr << "Test file cannot be opened!" << std::endl;
     exit(EXIT_FAILURE);
@@ -225,9 +449,14 @@ void FastText::test(const std::string& filename, int32_t k) {
   std::cout << "Number of examples: " << nexamples << std::endl;
 }
 
+// P@k on a tokenized held-out set, as test() computes it.
+real FastText::precision(const Corpus& corpus, int32_t k) {
+  return Validation::precision(*model_, *dict_, corpus, *args_, k);
+}
+
 void FastText::predict(const std::string& filename, int32_t k, bool print_prob) {
   std::vector<int32_t> line, labels;
-  std::ifstream ifs(filename);
+  InputStream ifs(filename);
   if (!ifs.is_open()) {
     std::cerr << "Test file cannot be opened!" << std::endl;
     exit(EXIT_FAILURE);
@@ -256,8 +485,8 @@ void FastText::predict(const std::string& filename, int32_t k, bool print_prob)
 }
 
 void FastText::close(std::string suffix) {
-  for(int i = 0; i < ifs.size(); i++) { ifs[i].close(); }
-  model_ = std::make_shared<Model>(input_, output_, args_, 0);
+  profile::Phase phase("close");
+  if (reader_) reader_->close();
   saveModel(suffix);
   saveVectors(suffix);
 }
@@ -281,7 +510,7 @@ void FastText::cbow(Model& model, real lr, const std::vector<int32_t>& line) {
     bow.clear();
     for (int32_t c = -boundary; c <= boundary; c++) {
       if (c != 0 && w + c >= 0 && w + c < line.size()) {
-        const std::vector<int32_t>& ngrams = dict_->getNgrams(line[w + c]);
+        id_range ngrams = dict_->getNgrams(line[w + c]);
         bow.insert(bow.end(), ngrams.cbegin(), ngrams.cend());
       }
     }
@@ -289,35 +518,76 @@ void FastText::cbow(Model& model, real lr, const std::vector<int32_t>& line) {
   }
 }
 
+// The windows of the whole line are drawn first (the draws come in the
+// same order as before), which gives the list of (center, context) updates
+// ahead of time: with -prefetch, the rows of the update that many steps
+// ahead are requested before each one runs.
 void FastText::skipgram(Model& model, real lr, const std::vector<int32_t>& line) {
   std::uniform_int_distribution<> uniform(1, args_->ws);
+  schedule_.clear();
   for (int32_t w = 0; w < line.size(); w++) {
     int32_t boundary = uniform(model.rng);
-    const std::vector<int32_t>& ngrams = dict_->getNgrams(line[w]);
     for (int32_t c = -boundary; c <= boundary; c++) {
       if (c != 0 && w + c >= 0 && w + c < line.size()) {
-        model.update(ngrams, line[w + c], lr);
+        schedule_.push_back(std::make_pair(w, line[w + c]));
       }
     }
   }
+  const int64_t ahead = args_->prefetch;
+  id_range ngrams(nullptr, nullptr);
+  for (int64_t k = 0; k < schedule_.size(); k++) {
+    int64_t next = k + ahead;
+    if (ahead > 0 && next < schedule_.size()) {
+      if (schedule_[next].first != schedule_[next - 1].first) {
+        model.prefetchInput(dict_->getNgrams(line[schedule_[next].first]));
+      }
+      model.prefetchOutput(schedule_[next].second, ahead);
+    }
+    if (k == 0 || schedule_[k].first != schedule_[k - 1].first) {
+      ngrams = dict_->getNgrams(line[schedule_[k].first]);
+    }
+    model.update(ngrams, schedule_[k].second, lr);
+  }
 }
 
+// Update k pairs word k / |y| of x with word k % |y| of y; -prefetch works
+// as in skipgram.
 void FastText::bilingual_skipgram(Model& model, real lr, const std::vector<int32_t>& x, const std::vector<int32_t>& y) {
   real lr_x = lr * (args_->ws) / y.size();
+  const int64_t ahead = args_->prefetch;
+  const int64_t total = int64_t(x.size()) * y.size();
   
+  int64_t k = 0;
   for (int32_t w = 0; w < x.size(); w++) {
-    const std::vector<int32_t>& ngrams_x = dict_->getNgrams(x[w]);
-    for (int32_t i = 0; i < y.size(); i++) {
+    id_range ngrams_x = dict_->getNgrams(x[w]);
+    for (int32_t i = 0; i < y.size(); i++, k++) {
+      int64_t next = k + ahead;
+      if (ahead > 0 && next < total) {
+        if (next % y.size() == 0) {
+          model.prefetchInput(dict_->getNgrams(x[next / y.size()]));
+        }
+        model.prefetchOutput(y[next % y.size()], ahead);
+      }
       model.update(ngrams_x, y[i], lr_x);
     }
   }
 }
 
+// Output-only instance: enough state to save a trained model, without the
+// Model (and its negative table) or the input streams a trainer needs.
+FastText::FastText(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict, std::shared_ptr<Matrix> input,
+                     std::shared_ptr<Matrix> output) {
+  args_ = args;
+  dict_ = dict;
+  input_ = input;
+  output_ = output;
+}
+
 FastText::FastText(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict, std::shared_ptr<Matrix> input,
-                     std::shared_ptr<Matrix> output, int32_t threadId) {
+                     std::shared_ptr<Matrix> output, int32_t threadId, std::shared_ptr<Metrics> metrics,
+                     std::shared_ptr<CorpusCache> corpora) {
   
   // Set attributes
-  start = clock();
   threadId_ = threadId;
   args_ = args;
   dict_ = dict;
@@ -331,50 +601,155 @@ FastText::FastText(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict,
   } else {
     model_->setTargetCounts(dict_->getCounts(entry_type::word), dict_);
   }
+  if (metrics) {
+    metrics_ = metrics->registerSlot(args_->name, threadId, args_->lr, args_->epoch * dict_->ntokens());
+    model_->setMetrics(metrics_);
+  }
   
   // IO streams
-  std::vector<std::string> possible_inputs = {args->input, args->input_mono1, args->input_mono2, args->input_par1, args->input_par2};
-  for(auto possible_input : possible_inputs) {
-    if(!possible_input.empty()) {
-      ifs.push_back(std::ifstream(possible_input));
-      for (int i = 0; i < (threadId * args_->threadOffset); ++i) {
-        ifs.back().ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  reader_ = std::make_shared<ExampleReader>(args_, dict_, threadId, corpora);
+}
+
+void FastText::setCheckpoint(std::shared_ptr<Checkpoint> checkpoint) {
+  checkpoint_ = checkpoint;
+  if (args_->resume) {
+    std::istringstream state(checkpoint_->restoredState(args_->name, threadId_));
+    loadState(state);
+  }
+  checkpointSlot_ = checkpoint_->registerTask(args_->name, threadId_);
+}
+
+// Trains on every `nshards`-th line only, starting at line `shard`. Parallel
+// streams skip the same lines, so they stay aligned.
+void FastText::setShard(int32_t shard, int32_t nshards) {
+  nshards_ = nshards;
+  reader_->setShard(shard, nshards);
+  if (metrics_ != nullptr) {
+    metrics_->targetTokens /= nshards;
+  }
+}
+
+// Scales the learning rate by the cuts of `validation`, and ends training
+// when it stops it.
+void FastText::setValidation(std::shared_ptr<Validation> validation) {
+  validation_ = validation;
+}
+
+void FastText::setWorker(std::shared_ptr<Worker> worker) {
+  worker_ = worker;
+}
+
+// Hands the input streams to the reader threads of `pipeline`, if it has
+// any. Must come after setCheckpoint, which may still seek the streams.
+void FastText::setPipeline(std::shared_ptr<Pipeline> pipeline) {
+  if (!pipeline->enabled()) return;
+  channel_ = pipeline->add(reader_);
+}
+
+// The next example, parsed here or popped from the batches the reader
+// threads parsed ahead.
+Example& FastText::nextExample() {
+  if (!channel_) {
+    std::uniform_real_distribution<> uniform(0, 1);
+    reader_->read(example_, uniform(model_->rng));
+    return example_;
+  }
+  if (batch_ == nullptr || cursor_ == batch_->size) {
+    if (batch_ != nullptr) {
+      channel_->free.push(batch_);
+    }
+    if (!channel_->full.pop(batch_)) {
+      profile::Phase phase("pipeline.wait");
+      while (!channel_->full.pop(batch_)) {
+        std::this_thread::yield();
       }
     }
+    cursor_ = 0;
+  }
+  return batch_->examples[cursor_++];
+}
+
+// Called from step() only. With reader threads the streams are ahead of
+// training, so the positions saved are those at the start of the current
+// batch and a resumed run repeats at most one batch.
+void FastText::saveState(std::ostream& out) {
+  int64_t tokens = tokenCount;
+  std::vector<int64_t> positions = channel_ ? batch_->positions : reader_->positions();
+  int32_t nstreams = positions.size();
+  out.write((char*) &tokens, sizeof(int64_t));
+  out.write((char*) &progress, sizeof(real));
+  model_->saveState(out);
+  out.write((char*) &nstreams, sizeof(int32_t));
+  out.write((char*) positions.data(), nstreams * sizeof(int64_t));
+}
+
+void FastText::loadState(std::istream& in) {
+  int64_t tokens;
+  int32_t nstreams;
+  in.read((char*) &tokens, sizeof(int64_t));
+  in.read((char*) &progress, sizeof(real));
+  model_->loadState(in);
+  in.read((char*) &nstreams, sizeof(int32_t));
+  std::vector<int64_t> positions(nstreams);
+  in.read((char*) positions.data(), nstreams * sizeof(int64_t));
+  reader_->seek(positions);
+  tokenCount = tokens;
+  if (metrics_ != nullptr) {
+    MetricsSlot::add(metrics_->tokens, tokens);
   }
 }
 
 void FastText::step() {
-  std::vector<int32_t> line1, line2, labels;
-  
-  step_counter_ += 1;
-  progress = real(tokenCount) / (args_->epoch * dict_->ntokens()); // This is the _total_ number of tokens.  Not just the number in the relevant dataset
-  real lr = args_->lr * (1.0 - progress);
-  
-  std::uniform_real_distribution<> uniform(0, 1);
-  real u = uniform(model_->rng);
+  progress = real(tokenCount) * nshards_ / (args_->epoch * dict_->ntokens()); // This is the _total_ number of tokens.  Not just the number in the relevant dataset
+  if (validation_ && validation_->stopped()) {
+    progress = 1;
+  }
+  real lr = args_->schedule(args_->lr, progress);
+  if (validation_) {
+    lr *= validation_->lrScale();
+  }
   
-  tokenCount += dict_->getLine(ifs[0], line1, labels, args_->model, u);
+  const Example& example = nextExample();
+  int32_t ntokens = example.ntokens;
+  tokenCount += ntokens;
+  if (metrics_ != nullptr) {
+    MetricsSlot::add(metrics_->tokens, int64_t(ntokens));
+  }
   
   if (args_->model == model_name::sup) {
-    dict_->addNgrams(line1, args_->wordNgrams);
-    supervised(*model_, lr, line1, labels);
+    supervised(*model_, lr, example.line1, example.labels);
   } else if (args_->model == model_name::sg) {
-    skipgram(*model_, lr, line1);
+    skipgram(*model_, lr, example.line1);
   } else if (args_->model == model_name::bil) {
-    dict_->getLine(ifs[1], line2, labels, args_->model, u);
-    
-    bilingual_skipgram(*model_, lr, line1, line2);
-    bilingual_skipgram(*model_, lr, line2, line1);
+    bilingual_skipgram(*model_, lr, example.line1, example.line2);
+    bilingual_skipgram(*model_, lr, example.line2, example.line1);
+  }
+  if (worker_) {
+    worker_->step(ntokens);
   }
   
-  if ((step_counter_ % args_->lrUpdateRate == 0) && (threadId_ == 0)) {
-    if (args_->verbose > 1) {
-      printInfo(progress, model_->getLoss());
+  // A task is never stepped again once its progress reaches 1, so that is
+  // the last chance to hand its state to the checkpointer.
+  if (progress >= 1) {
+    model_->flush();
+    model_->mergeHotRows();
+    if (channel_) {
+      channel_->closed = true;
     }
   }
+  if (checkpointSlot_ != nullptr && (progress >= 1 || checkpoint_->requested(checkpointSeen_))) {
+    if (progress < 1) {
+      model_->flush();
+      model_->mergeHotRows();
+    }
+    std::ostringstream state;
+    saveState(state);
+    checkpointSeen_ = checkpoint_->publish(checkpointSlot_, state.str(), progress >= 1);
+  }
 }
 
+// Steps whichever task is furthest behind. Each task trains with its own
+// engine: one example at a time, or in mini-batches when its -batch_* is set.
 void lockTrain(std::vector<FastText*> models, real progress) {
   while(progress < 1) {
     FastText* min_model_ = models[0];
@@ -390,21 +765,233 @@ void lockTrain(std::vector<FastText*> models, real progress) {
   }
 }
 
+// Refuses to start if the matrices and per-task models would push the
+// ledger past -memBudget. Called once the dictionary is known, before any
+// of the large allocations.
+void checkMemoryBudget(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict,
+                       const std::vector<std::shared_ptr<Args>>& tasks, int32_t threads) {
+  int64_t row = alloc::rowStride(args->dim) * sizeof(real);
+  std::vector<profile::Estimate> planned;
+  planned.push_back({"matrix.input", (dict->nwords() + args->bucket) * row});
+  planned.push_back({"matrix.output_word", dict->nwords() * row});
+  int32_t replicas = std::min(numa::replicaCount(args), threads);
+  if (replicas > 1) {
+    planned.push_back({"replicas", (replicas - 1) * (2 * dict->nwords() + args->bucket) * row});
+  }
+  int64_t models = 0;
+  for (auto& task : tasks) {
+    if (task->model == model_name::sup) {
+      planned.push_back({"matrix.output_label", dict->nlabels() * row});
+      models += threads * Model::estimateMemory(task, dict->nlabels(), dict->nwords());
+    } else {
+      models += threads * Model::estimateMemory(task, dict->nwords(), dict->nwords());
+    }
+  }
+  planned.push_back({"model.*", models});
+  profile::checkBudget(int64_t(args->memBudget) << 20, planned);
+}
+
+// Builds the dictionary and the matrices shared by the tasks of a training
+// run: from <output>.ckpt with -resume, from a model extended with the new
+// data with -pretrained, and from scratch otherwise. output_label is only
+// created when one of the tasks is supervised.
+void setupTraining(std::shared_ptr<Args> args, const std::vector<std::shared_ptr<Args>>& tasks,
+                   int32_t threads, std::shared_ptr<Checkpoint> checkpoint,
+                   std::shared_ptr<Dictionary>& dict, std::shared_ptr<Matrix>& input,
+                   std::shared_ptr<Matrix>& output_word, std::shared_ptr<Matrix>& output_label) {
+  std::ifstream pretrained;
+  Args stored;
+  int32_t version = 0;
+  if (!args->pretrained.empty()) {
+    pretrained.open(args->pretrained, std::ifstream::binary);
+    if (!pretrained.is_open()) {
+      std::cerr << "Pretrained model cannot be opened for loading!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    version = readModelHeader(pretrained);
+    stored.load(pretrained);
+    args->copyStructure(stored);
+    for (auto& task : tasks) {
+      task->copyStructure(stored);
+    }
+  }
+  bool warm = pretrained.is_open() && !args->resume;
+  
+  int32_t nwords = 0;
+  if (args->resume) {
+    dict = checkpoint->restore();
+  } else if (warm) {
+    std::cerr << "--\nExtending dictionary of " << args->pretrained << std::endl;
+    std::shared_ptr<Args> dargs = std::make_shared<Args>(*args);
+    dargs->input.clear();
+    dargs->input_mono1.clear();
+    dargs->input_mono2.clear();
+    dargs->dict.clear();
+    dict = std::make_shared<Dictionary>(dargs);
+    dict->load(pretrained, version);
+    nwords = dict->nwords();
+    std::vector<std::string> inputs = {args->input, args->input_mono1, args->input_mono2};
+    dict->extend(inputs);
+  } else {
+    dict = std::make_shared<Dictionary>(args);
+  }
+  checkpoint->setDictionary(dict);
+  
+  bool sup = false;
+  for (auto& task : tasks) {
+    sup = sup || task->model == model_name::sup;
+  }
+  checkMemoryBudget(args, dict, tasks, threads);
+  
+  // The input rows are drawn by as many threads as will train them, so that
+  // their pages are first touched where training runs. With -numa, the
+  // shared matrices are replica 0, trained by the threads of the first node.
+  std::function<void(int32_t)> place;
+  if (args->numa) {
+    std::vector<int32_t> cpus = numa::nodes()[0];
+    place = [cpus](int32_t) { numa::bindToCpus(cpus); };
+  }
+  std::cerr << "--\nCreating input matrix" << std::endl;
+  if (warm) {
+    input = std::make_shared<Matrix>();
+    input->account_.rename("matrix.input");
+    if (version >= 2) Matrix::skipPadding(pretrained);
+    input->load(pretrained);
+    if (input->m_ != nwords + args->bucket || input->n_ != args->dim) {
+      std::cerr << args->pretrained << " has an input matrix that does not match its dictionary." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    input->grow(dict->nwords() + args->bucket, 1.0 / args->dim, threads, place);
+  } else {
+    input = std::make_shared<Matrix>(dict->nwords() + args->bucket, args->dim);
+    input->account_.rename("matrix.input");
+    if (args->resume) {
+      checkpoint->restoreMatrix("input", input);
+    } else {
+      input->uniform(1.0 / args->dim, threads, place);
+    }
+  }
+  checkpoint->addMatrix("input", input);
+  
+  // The output matrix of the pretrained model is kept for the tasks of its
+  // own kind; the other one starts from zero as usual. New matrices are
+  // zero already, on pages that are only touched once training writes them.
+  std::shared_ptr<Matrix> output;
+  if (warm) {
+    output = std::make_shared<Matrix>();
+    if (version >= 2) Matrix::skipPadding(pretrained);
+    output->load(pretrained);
+    if (stored.model == model_name::sup) {
+      output->grow(dict->nlabels(), 0.0);
+    } else {
+      output->grow(dict->nwords(), 0.0);
+    }
+    pretrained.close();
+  }
+  if (warm && stored.model != model_name::sup) {
+    output_word = output;
+  } else {
+    output_word = std::make_shared<Matrix>(dict->nwords(), args->dim);
+  }
+  output_word->account_.rename("matrix.output_word");
+  if (sup) {
+    if (warm && stored.model == model_name::sup) {
+      output_label = output;
+    } else {
+      output_label = std::make_shared<Matrix>(dict->nlabels(), args->dim);
+    }
+    output_label->account_.rename("matrix.output_label");
+  }
+  
+  std::vector<std::pair<std::string, std::shared_ptr<Matrix>>> outputs = {{"output_word", output_word}};
+  if (sup) {
+    outputs.push_back({"output_label", output_label});
+  }
+  for (auto& o : outputs) {
+    if (args->resume) {
+      checkpoint->restoreMatrix(o.first, o.second);
+    }
+    checkpoint->addMatrix(o.first, o.second);
+  }
+}
+
+// -workers: forks one training process per shard of the corpora, each with
+// a copy of the matrices, and averages them in this process (see dist.h).
+// Worker 0 reports the metrics.
+void trainWorkers(std::shared_ptr<Args> args, const std::vector<std::shared_ptr<Args>>& tasks,
+                  std::shared_ptr<Dictionary> dict, std::shared_ptr<Matrix> input,
+                  std::shared_ptr<Matrix> output) {
+  if (args->checkpoint > 0 || args->resume) {
+    std::cerr << "-workers cannot be combined with -checkpoint or -resume." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // Each worker trains as thread `rank`, which keeps their random streams
+  // apart but would also skip rank * -threadOffset lines on top of the
+  // shard, so that the shards overlap and some lines are never trained.
+  if (args->threadOffset != 0) {
+    std::cerr << "-workers cannot be combined with -threadOffset; the shards already split the data." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  Coordinator coordinator(args, {input, output});
+  std::vector<pid_t> pids;
+  std::cout.flush();
+  std::cerr.flush();
+  for (int32_t rank = 0; rank < args->workers; rank++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "Cannot start worker " << rank << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      std::shared_ptr<Worker> worker = std::make_shared<Worker>(
+          args, coordinator.path(), std::vector<std::shared_ptr<Matrix>>{input, output});
+      std::shared_ptr<Metrics> metrics = rank == 0 ? std::make_shared<Metrics>(args) : nullptr;
+      std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(args);
+      std::vector<std::unique_ptr<FastText>> trainers;
+      std::vector<FastText*> models;
+      for (auto& task : tasks) {
+        trainers.emplace_back(new FastText(task, dict, input, output, rank, metrics));
+        trainers.back()->setShard(rank, args->workers);
+        trainers.back()->setWorker(worker);
+        trainers.back()->setPipeline(pipeline);
+        models.push_back(trainers.back().get());
+      }
+      if (metrics) metrics->start();
+      pipeline->start();
+      real progress(0);
+      lockTrain(models, progress);
+      pipeline->stop();
+      worker->finish();
+      if (metrics) metrics->stop();
+      std::cout.flush();
+      std::cerr.flush();
+      _exit(EXIT_SUCCESS);
+    }
+    pids.push_back(pid);
+  }
+  coordinator.accept(pids);
+  {
+    profile::Phase phase("train");
+    coordinator.serve();
+  }
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      std::cerr << "A worker process failed." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
 void trainBilingualSupervised(int argc, char** argv) {
   std::cerr << "--\nParsing arguments" << std::endl;
   std::shared_ptr<Args> args = std::make_shared<Args>();
   args->parseArgs(argc, argv);
-  
-  std::cerr << "--\nCreating input matrix" << std::endl;
-  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
-  std::shared_ptr<Matrix> input = std::make_shared<Matrix>(dict->nwords()+args->bucket, args->dim);
-  input->uniform(1.0 / args->dim);
-  
-  std::shared_ptr<Matrix> output_word, output_label;
-  output_word = std::make_shared<Matrix>(dict->nwords(), args->dim);
-  output_label = std::make_shared<Matrix>(dict->nlabels(), args->dim);
-  output_word->zero();
-  output_label->zero();
+  if (args->workers > 1) {
+    std::cerr << "-workers trains in several processes: use bilingual-um." << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
   std::shared_ptr<Args> args_sup = std::make_shared<Args>(*args);
   std::shared_ptr<Args> args_par = std::make_shared<Args>(*args);
@@ -416,32 +1003,62 @@ void trainBilingualSupervised(int argc, char** argv) {
   args_mono1->toggleMono(1);
   args_mono2->toggleMono(2);
   
-  FastText ft_sup{args_sup, dict, input, output_label, 0};
-  FastText ft_par{args_par, dict, input, output_word, 0};
-  FastText ft_mono1{args_mono1, dict, input, output_word, 0};
-  FastText ft_mono2{args_mono2, dict, input, output_word, 0};
+  std::shared_ptr<Checkpoint> checkpoint = std::make_shared<Checkpoint>(args);
+  std::shared_ptr<Dictionary> dict;
+  std::shared_ptr<Matrix> input, output_word, output_label;
+  setupTraining(args, {args_sup, args_par, args_mono1, args_mono2}, 1, checkpoint,
+                dict, input, output_word, output_label);
+  
+  std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>(args);
+  
+  FastText ft_sup{args_sup, dict, input, output_label, 0, metrics};
+  
+  ft_sup.setCheckpoint(checkpoint);
+  FastText ft_par{args_par, dict, input, output_word, 0, metrics};
+  ft_par.setCheckpoint(checkpoint);
+  FastText ft_mono1{args_mono1, dict, input, output_word, 0, metrics};
+  ft_mono1.setCheckpoint(checkpoint);
+  FastText ft_mono2{args_mono2, dict, input, output_word, 0, metrics};
+  ft_mono2.setCheckpoint(checkpoint);
   
   std::vector<FastText*> models = {&ft_sup, &ft_par, &ft_mono1, &ft_mono2};
+  std::shared_ptr<Validation> validation;
+  if (!args->valid.empty()) {
+    validation = std::make_shared<Validation>(args_sup, dict, input, output_label, metrics);
+    for (auto model : models) {
+      model->setValidation(validation);
+    }
+  }
+  std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(args);
+  for (auto model : models) {
+    model->setPipeline(pipeline);
+  }
   real progress(0);
-  lockTrain(models, progress);
+  metrics->start();
+  checkpoint->start();
+  pipeline->start();
+  if (validation) validation->start();
+  {
+    profile::Phase phase("train");
+    lockTrain(models, progress);
+  }
+  pipeline->stop();
+  checkpoint->stop(true);
+  metrics->stop();
+  if (validation) validation->stop();
   
-  FastText ft_out{args_sup, dict, input, output_label, 0};
-  ft_out.close("-no-thread");
+  ft_sup.close("-no-thread");
+  if (args->verbose > 0) profile::printSummary(std::cerr);
 }
 
 void trainBilingualUnsupervisedMono(int argc, char** argv) {
   std::cerr << "--\nParsing arguments" << std::endl;
   std::shared_ptr<Args> args = std::make_shared<Args>();
   args->parseArgs(argc, argv);
-  
-  std::cerr << "--\nCreating input matrix" << std::endl;
-  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
-  std::shared_ptr<Matrix> input = std::make_shared<Matrix>(dict->nwords()+args->bucket, args->dim);
-  input->uniform(1.0 / args->dim);
-  
-  std::shared_ptr<Matrix> output_word;
-  output_word = std::make_shared<Matrix>(dict->nwords(), args->dim);
-  output_word->zero();
+  if (!args->valid.empty()) {
+    std::cerr << "-valid scores a supervised task: use bilingual-s." << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
   std::shared_ptr<Args> args_par = std::make_shared<Args>(*args);
   std::shared_ptr<Args> args_mono1 = std::make_shared<Args>(*args);
@@ -451,16 +1068,49 @@ void trainBilingualUnsupervisedMono(int argc, char** argv) {
   args_mono1->toggleMono(1);
   args_mono2->toggleMono(2);
   
-  FastText ft_par{args_par, dict, input, output_word, 0};
-  FastText ft_mono1{args_mono1, dict, input, output_word, 0};
-  FastText ft_mono2{args_mono2, dict, input, output_word, 0};
+  std::shared_ptr<Checkpoint> checkpoint = std::make_shared<Checkpoint>(args);
+  std::shared_ptr<Dictionary> dict;
+  std::shared_ptr<Matrix> input, output_word, output_label;
+  setupTraining(args, {args_par, args_mono1, args_mono2}, 1, checkpoint,
+                dict, input, output_word, output_label);
+  
+  if (args->workers > 1) {
+    trainWorkers(args, {args_par, args_mono1, args_mono2}, dict, input, output_word);
+    FastText ft_out{args_par, dict, input, output_word};
+    ft_out.close("-no-thread");
+    if (args->verbose > 0) profile::printSummary(std::cerr);
+    return;
+  }
+  
+  std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>(args);
+  
+  FastText ft_par{args_par, dict, input, output_word, 0, metrics};
+  
+  ft_par.setCheckpoint(checkpoint);
+  FastText ft_mono1{args_mono1, dict, input, output_word, 0, metrics};
+  ft_mono1.setCheckpoint(checkpoint);
+  FastText ft_mono2{args_mono2, dict, input, output_word, 0, metrics};
+  ft_mono2.setCheckpoint(checkpoint);
   
   std::vector<FastText*> models = {&ft_par, &ft_mono1, &ft_mono2};
+  std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(args);
+  for (auto model : models) {
+    model->setPipeline(pipeline);
+  }
   real progress(0);
-  lockTrain(models, progress);
+  metrics->start();
+  checkpoint->start();
+  pipeline->start();
+  {
+    profile::Phase phase("train");
+    lockTrain(models, progress);
+  }
+  pipeline->stop();
+  checkpoint->stop(true);
+  metrics->stop();
   
-  FastText ft_out{args_par, dict, input, output_word, 0};
   ft_par.close("-no-thread");
+  if (args->verbose > 0) profile::printSummary(std::cerr);
 }
 
 
@@ -468,16 +1118,15 @@ void trainBilingualUnsupervisedMonoThread(int argc, char** argv) {
   std::cerr << "--\nParsing arguments" << std::endl;
   std::shared_ptr<Args> args = std::make_shared<Args>();
   args->parseArgs(argc, argv);
+  if (!args->valid.empty()) {
+    std::cerr << "-valid scores a supervised task: use bilingual-s." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (args->workers > 1) {
+    std::cerr << "-workers trains in several processes: use bilingual-um." << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
-  std::cerr << "--\nCreating input matrix" << std::endl;
-  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
-  std::shared_ptr<Matrix> input = std::make_shared<Matrix>(dict->nwords()+args->bucket, args->dim);
-  input->uniform(1.0 / args->dim);
-  
-  std::shared_ptr<Matrix> output_word;
-  output_word = std::make_shared<Matrix>(dict->nwords(), args->dim);
-  output_word->zero();
-
   std::shared_ptr<Args> args_par = std::make_shared<Args>(*args);
   std::shared_ptr<Args> args_mono1 = std::make_shared<Args>(*args);
   std::shared_ptr<Args> args_mono2 = std::make_shared<Args>(*args);
@@ -486,29 +1135,170 @@ void trainBilingualUnsupervisedMonoThread(int argc, char** argv) {
   args_mono1->toggleMono(1);
   args_mono2->toggleMono(2);
   
-  std::vector<std::thread> threads;
-  for(int32_t threadId = 0; threadId < args->thread; threadId++) {
-    std::cerr << "spawning thread : " << threadId << std::endl;
-    threads.push_back(std::thread([=]() {
-      FastText ft_par{args_par, dict, input, output_word, threadId};
-      FastText ft_mono1{args_mono1, dict, input, output_word, threadId};
-      FastText ft_mono2{args_mono2, dict, input, output_word, threadId};
-      
-      std::vector<FastText*> models = {&ft_par, &ft_mono1, &ft_mono2};
-      real progress(0);
-      lockTrain(models, progress);
-    }));
+  // The main thread initializes the matrices, which puts replica 0 on the
+  // first node. It gets its own CPUs back afterwards, so that the threads it
+  // starts later (readers, metrics, checkpoints) are not confined there.
+  std::vector<int32_t> cpus;
+  if (args->numa) {
+    cpus = numa::boundCpus();
+    numa::bindToCpus(numa::nodes()[0]);
   }
-  for (auto it = threads.begin(); it != threads.end(); ++it) {
-    it->join();
+  
+  std::shared_ptr<Checkpoint> checkpoint = std::make_shared<Checkpoint>(args);
+  std::shared_ptr<Dictionary> dict;
+  std::shared_ptr<Matrix> input, output_word, output_label;
+  setupTraining(args, {args_par, args_mono1, args_mono2}, args->thread, checkpoint,
+                dict, input, output_word, output_label);
+  if (!cpus.empty()) {
+    numa::bindToCpus(cpus);
   }
   
-  FastText ft_out{args_par, dict, input, output_word, 0};
+  std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>(args);
+  std::shared_ptr<Replicas> replicas = std::make_shared<Replicas>(args, metrics, input, output_word);
+  std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>(args);
+  
+  std::vector<std::thread> threads;
+  metrics->start();
+  checkpoint->start();
+  replicas->start();
+  pipeline->start();
+  {
+    profile::Phase phase("train");
+    for(int32_t threadId = 0; threadId < args->thread; threadId++) {
+      std::cerr << "spawning thread : " << threadId << std::endl;
+      threads.push_back(std::thread([=]() {
+        replicas->bindThread(threadId);
+        std::shared_ptr<Matrix> in = replicas->input(threadId);
+        std::shared_ptr<Matrix> out = replicas->output(threadId);
+        FastText ft_par{args_par, dict, in, out, threadId, metrics};
+        ft_par.setCheckpoint(checkpoint);
+        FastText ft_mono1{args_mono1, dict, in, out, threadId, metrics};
+        ft_mono1.setCheckpoint(checkpoint);
+        FastText ft_mono2{args_mono2, dict, in, out, threadId, metrics};
+        ft_mono2.setCheckpoint(checkpoint);
+        
+        std::vector<FastText*> models = {&ft_par, &ft_mono1, &ft_mono2};
+        for (auto model : models) {
+          model->setPipeline(pipeline);
+        }
+        real progress(0);
+        lockTrain(models, progress);
+      }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+  }
+  pipeline->stop();
+  replicas->stop();
+  checkpoint->stop(true);
+  metrics->stop();
+  
+  FastText ft_out{args_par, dict, input, output_word};
   ft_out.close("-thread");
+  if (args->verbose > 0) profile::printSummary(std::cerr);
+}
+
+// One trial of a sweep: the tasks of bilingual-s on fresh matrices, trained
+// on one thread from the shared dictionary and corpora, then scored on the
+// held-out set.
+Sweep::Result sweepTrial(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict,
+                         std::shared_ptr<CorpusCache> corpora, const Corpus& valid) {
+  auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<Args> args_sup = std::make_shared<Args>(*args);
+  std::shared_ptr<Args> args_par = std::make_shared<Args>(*args);
+  std::shared_ptr<Args> args_mono1 = std::make_shared<Args>(*args);
+  std::shared_ptr<Args> args_mono2 = std::make_shared<Args>(*args);
+  args_sup->toggleSup();
+  args_par->togglePar();
+  args_mono1->toggleMono(1);
+  args_mono2->toggleMono(2);
+  
+  std::shared_ptr<Matrix> input = std::make_shared<Matrix>(dict->nwords() + args->bucket, args->dim);
+  std::shared_ptr<Matrix> output_word = std::make_shared<Matrix>(dict->nwords(), args->dim);
+  std::shared_ptr<Matrix> output_label = std::make_shared<Matrix>(dict->nlabels(), args->dim);
+  input->uniform(1.0 / args->dim);
+  
+  FastText ft_sup{args_sup, dict, input, output_label, 0, nullptr, corpora};
+  FastText ft_par{args_par, dict, input, output_word, 0, nullptr, corpora};
+  FastText ft_mono1{args_mono1, dict, input, output_word, 0, nullptr, corpora};
+  FastText ft_mono2{args_mono2, dict, input, output_word, 0, nullptr, corpora};
+  real progress(0);
+  lockTrain({&ft_sup, &ft_par, &ft_mono1, &ft_mono2}, progress);
+  
+  Sweep::Result result;
+  result.precision = ft_sup.precision(valid, 1);
+  result.loss = ft_sup.model_->getLoss();
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+// Trains one bilingual-s model per trial of the command line (see sweep.h),
+// -thread trials at a time, and prints their scores on -valid as a table.
+// The dictionary is built and every corpus tokenized once for all trials;
+// nothing is saved.
+void sweep(int argc, char** argv) {
+  std::vector<std::string> argvs(argv, argv + argc);
+  Sweep sweep(argvs);
+  std::vector<char*> rest;
+  for (auto& arg : argvs) {
+    rest.push_back(&arg[0]);
+  }
+  std::shared_ptr<Args> args = std::make_shared<Args>();
+  args->parseArgs(rest.size(), rest.data());
+  if (args->valid.empty()) {
+    std::cerr << "sweep needs held-out data to score the trials on (-valid)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  
+  std::shared_ptr<Dictionary> dict = std::make_shared<Dictionary>(args);
+  std::shared_ptr<CorpusCache> corpora = std::make_shared<CorpusCache>(dict);
+  std::cerr << "--\nTokenizing corpora" << std::endl;
+  for (auto& file : {args->input, args->input_mono1, args->input_mono2, args->input_par1, args->input_par2}) {
+    if (!file.empty()) corpora->get(file);
+  }
+  std::shared_ptr<Corpus> valid = corpora->get(args->valid);
+  
+  std::vector<std::vector<double>> trials = sweep.trials();
+  std::vector<Sweep::Result> results(trials.size());
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::cerr << "--\nRunning " << trials.size() << " trials" << std::endl;
+  auto work = [&]() {
+    for (size_t t = next++; t < trials.size(); t = next++) {
+      std::shared_ptr<Args> targs = std::make_shared<Args>(*args);
+      sweep.apply(trials[t], *targs);
+      results[t] = sweepTrial(targs, dict, corpora, *valid);
+      results[t].trial = t;
+      results[t].values = trials[t];
+      std::lock_guard<std::mutex> lock(mutex);
+      std::cerr << "trial " << t << ": P@1 " << results[t].precision << std::endl;
+    }
+  };
+  {
+    profile::Phase phase("train");
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < std::min(size_t(args->thread), trials.size()); i++) {
+      threads.push_back(std::thread(work));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  sweep.printTable(std::cout, results);
+  if (args->verbose > 0) profile::printSummary(std::cerr);
+}
+
+void buildDict(int argc, char** argv) {
+  std::shared_ptr<Args> args = std::make_shared<Args>();
+  args->parseArgs(argc, argv);
+  args->dict.clear();
+  Dictionary dict(args);
+  dict.saveToFile(args->output + ".dict");
+  std::cerr << "Dictionary saved to " << args->output << ".dict" << std::endl;
 }
 
 int main(int argc, char** argv) {
-  utils::initTables();
   if (argc < 2) {
     printUsage();
     exit(EXIT_FAILURE);
@@ -521,16 +1311,21 @@ int main(int argc, char** argv) {
   } else if (command == "bilingual-s") {
     trainBilingualSupervised(argc, argv);
   
+  } else if (command == "build-dict") {
+    buildDict(argc, argv);
+  } else if (command == "sweep") {
+    sweep(argc, argv);
   } else if (command == "test") {
     test(argc, argv);
   } else if (command == "print-vectors") {
     printVectors(argc, argv);
+  } else if (command == "print-sentence-vectors") {
+    printSentenceVectors(argc, argv);
   } else if (command == "predict" || command == "predict-prob" ) {
     predict(argc, argv);
   } else {
     printUsage();
     exit(EXIT_FAILURE);
   }
-  utils::freeTables();
   return 0;
 }
@@ -10,28 +10,55 @@
 #ifndef FASTTEXT_FASTTEXT_H
 #define FASTTEXT_FASTTEXT_H
 
-#include <time.h>
-
 #include <atomic>
 #include <memory>
 
+#include "checkpoint.h"
+#include "corpus.h"
+#include "dist.h"
 #include "matrix.h"
 #include "vector.h"
 #include "dictionary.h"
+#include "input.h"
 #include "model.h"
+#include "metrics.h"
+#include "numa.h"
+#include "pipeline.h"
+#include "profile.h"
 #include "utils.h"
 #include "real.h"
 #include "args.h"
+#include "validation.h"
+
+#define FASTTEXT_VERSION 2 /* Version 2: matrices aligned for mapping */
+#define FASTTEXT_FILEFORMAT_MAGIC_INT32 793712314
+
+int32_t readModelHeader(std::istream&);
 
 class FastText {
   private:
-    clock_t start;
-    std::vector<std::ifstream> ifs;
+    std::shared_ptr<ExampleReader> reader_;
+    std::shared_ptr<Channel> channel_;
+    Batch* batch_{nullptr};
+    int32_t cursor_{0};
+    Example example_;
+    std::vector<int32_t> ngramsBuffer_;
+    std::vector<std::pair<int32_t, int32_t>> schedule_;
     int32_t threadId_{0};
-    int32_t step_counter_{0};
+    MetricsSlot* metrics_{nullptr};
+    std::shared_ptr<Checkpoint> checkpoint_;
+    CheckpointSlot* checkpointSlot_{nullptr};
+    int64_t checkpointSeen_{0};
+    std::shared_ptr<Worker> worker_;
+    std::shared_ptr<Validation> validation_;
+    int32_t nshards_{1};
+
+    Example& nextExample();
     
   public:
-    FastText(std::shared_ptr<Args>, std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, int32_t);
+    FastText(std::shared_ptr<Args>, std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, int32_t,
+             std::shared_ptr<Metrics> = nullptr, std::shared_ptr<CorpusCache> = nullptr);
+    FastText(std::shared_ptr<Args>, std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>, std::shared_ptr<Matrix>);
     FastText(const std::string&);
     std::atomic<int64_t> tokenCount{0};
     real progress{0};
@@ -44,10 +71,13 @@ class FastText {
     void getVector(Vector&, const std::string&);
     void saveVectors(const std::string);
     void printVectors();
+    void getSentenceVector(Vector&, const std::vector<int32_t>&);
+    int64_t embedLines(const std::string&, std::vector<real>&);
+    void printSentenceVectors(const std::string&, const std::string&, int32_t);
     void saveModel(const std::string);
     void loadModel(const std::string&);
-    void printInfo(real, real);
     void test(const std::string&, int32_t);
+    real precision(const Corpus&, int32_t);
     void predict(const std::string&, int32_t, bool);
 
     void supervised(Model&, real, const std::vector<int32_t>&, const std::vector<int32_t>&);
@@ -55,6 +85,14 @@ class FastText {
     void skipgram(Model&, real, const std::vector<int32_t>&);
     void bilingual_skipgram(Model&, real, const std::vector<int32_t>&, const std::vector<int32_t>&);
     
+    void setCheckpoint(std::shared_ptr<Checkpoint>);
+    void setShard(int32_t, int32_t);
+    void setValidation(std::shared_ptr<Validation>);
+    void setWorker(std::shared_ptr<Worker>);
+    void setPipeline(std::shared_ptr<Pipeline>);
+    void saveState(std::ostream&);
+    void loadState(std::istream&);
+
     void close(std::string);
     void train();
     void step();
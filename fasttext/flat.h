@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_FLAT_H
+#define FASTTEXT_FLAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read-only mapping of a whole file.
+class MappedFile {
+  private:
+    void* data_;
+    size_t size_;
+
+  public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string&);
+    const char* data() const;
+    size_t size() const;
+};
+
+// Contiguous array that either owns its elements or views read-only memory
+// kept alive by `mapping` (a mapped file). Reads go through one pointer
+// either way; the first write to a view copies it.
+template <typename T>
+class FlatArray {
+  private:
+    std::vector<T> own_;
+    const T* data_;
+    size_t size_;
+    std::shared_ptr<MappedFile> mapping_;
+
+    inline void own() {
+      if (mapping_) {
+        own_.assign(data_, data_ + size_);
+        mapping_.reset();
+      }
+    }
+    inline void sync() {
+      data_ = own_.data();
+      size_ = own_.size();
+    }
+
+  public:
+    FlatArray() : data_(nullptr), size_(0) {}
+    FlatArray(const FlatArray& other) { *this = other; }
+    FlatArray& operator=(const FlatArray& other) {
+      own_ = other.own_;
+      mapping_ = other.mapping_;
+      if (mapping_) {
+        data_ = other.data_;
+        size_ = other.size_;
+      } else {
+        sync();
+      }
+      return *this;
+    }
+
+    inline const T& operator[](size_t i) const { return data_[i]; }
+    inline const T* data() const { return data_; }
+    inline size_t size() const { return size_; }
+    inline bool mapped() const { return bool(mapping_); }
+
+    inline T& at(size_t i) {
+      own();
+      return own_[i];
+    }
+    inline void push_back(const T& x) {
+      own();
+      own_.push_back(x);
+      sync();
+    }
+    void append(const T* first, const T* last) {
+      own();
+      own_.insert(own_.end(), first, last);
+      sync();
+    }
+    void assign(size_t n, const T& x) {
+      mapping_.reset();
+      own_.assign(n, x);
+      sync();
+    }
+    // Takes the contents of `v`, leaving it with the previous ones.
+    void swap(std::vector<T>& v) {
+      own();
+      own_.swap(v);
+      sync();
+    }
+    void clear() {
+      mapping_.reset();
+      own_.clear();
+      own_.shrink_to_fit();
+      sync();
+    }
+    void view(std::shared_ptr<MappedFile> mapping, const T* data, size_t size) {
+      own_.clear();
+      own_.shrink_to_fit();
+      mapping_ = mapping;
+      data_ = data;
+      size_ = size;
+    }
+    // Heap bytes; a view holds none.
+    int64_t bytes() const {
+      return own_.capacity() * sizeof(T);
+    }
+};
+
+#endif
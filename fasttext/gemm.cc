@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "gemm.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace gemm {
+
+  // A block of op(B) (KC x NC reals) stays in L2 while every block of op(A)
+  // (MC x KC) streams past it; an op(A) block fits in L1.
+  const int64_t MC = 64;
+  const int64_t KC = 256;
+  const int64_t NC = 1024;
+
+  // Copies op(X)[i0:i0+rows, j0:j0+cols] into `out` row by row, scaled.
+  static void pack(bool trans, const real* x, int64_t ldx, int64_t i0, int64_t j0,
+                   int64_t rows, int64_t cols, real scale, real* out) {
+    for (int64_t i = 0; i < rows; i++) {
+      for (int64_t j = 0; j < cols; j++) {
+        const real v = trans ? x[(j0 + j) * ldx + i0 + i] : x[(i0 + i) * ldx + j0 + j];
+        out[i * cols + j] = scale * v;
+      }
+    }
+  }
+
+  // c[mc x nc] += a[mc x kc] * b[kc x nc] on packed blocks. Four rows of c
+  // share each load of a row of b, and the inner loop runs along the
+  // contiguous rows so that it vectorizes.
+  static void kernel(int64_t mc, int64_t nc, int64_t kc, const real* a, const real* b,
+                     real* c, int64_t ldc) {
+    int64_t i = 0;
+    for (; i + 4 <= mc; i += 4) {
+      real* c0 = c + i * ldc;
+      real* c1 = c0 + ldc;
+      real* c2 = c1 + ldc;
+      real* c3 = c2 + ldc;
+      for (int64_t p = 0; p < kc; p++) {
+        const real a0 = a[i * kc + p];
+        const real a1 = a[(i + 1) * kc + p];
+        const real a2 = a[(i + 2) * kc + p];
+        const real a3 = a[(i + 3) * kc + p];
+        const real* bp = b + p * nc;
+        for (int64_t j = 0; j < nc; j++) {
+          c0[j] += a0 * bp[j];
+          c1[j] += a1 * bp[j];
+          c2[j] += a2 * bp[j];
+          c3[j] += a3 * bp[j];
+        }
+      }
+    }
+    for (; i < mc; i++) {
+      real* ci = c + i * ldc;
+      for (int64_t p = 0; p < kc; p++) {
+        const real ai = a[i * kc + p];
+        const real* bp = b + p * nc;
+        for (int64_t j = 0; j < nc; j++) {
+          ci[j] += ai * bp[j];
+        }
+      }
+    }
+  }
+
+  void multiply(bool transA, bool transB, int64_t m, int64_t n, int64_t k,
+                real alpha, const real* a, int64_t lda, const real* b, int64_t ldb,
+                real* c, int64_t ldc) {
+    thread_local std::vector<real> packedA, packedB;
+    packedA.resize(MC * KC);
+    packedB.resize(KC * NC);
+    for (int64_t jc = 0; jc < n; jc += NC) {
+      int64_t nc = std::min(NC, n - jc);
+      for (int64_t pc = 0; pc < k; pc += KC) {
+        int64_t kc = std::min(KC, k - pc);
+        pack(transB, b, ldb, pc, jc, kc, nc, 1.0, packedB.data());
+        for (int64_t ic = 0; ic < m; ic += MC) {
+          int64_t mc = std::min(MC, m - ic);
+          pack(transA, a, lda, ic, pc, mc, kc, alpha, packedA.data());
+          kernel(mc, nc, kc, packedA.data(), packedB.data(), c + ic * ldc + jc, ldc);
+        }
+      }
+    }
+  }
+
+}
@@ -0,0 +1,28 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_GEMM_H
+#define FASTTEXT_GEMM_H
+
+#include <cstdint>
+
+#include "real.h"
+
+namespace gemm {
+
+  // C[m x n] += alpha * op(A)[m x k] * op(B)[k x n], all row-major with
+  // leading dimensions lda, ldb and ldc. op(X) is X, or its transpose when
+  // the matching flag is set.
+  void multiply(bool transA, bool transB, int64_t m, int64_t n, int64_t k,
+                real alpha, const real* a, int64_t lda, const real* b, int64_t ldb,
+                real* c, int64_t ldc);
+
+}
+
+#endif
@@ -0,0 +1,355 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "input.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef FASTTEXT_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#include "flat.h"
+
+namespace {
+
+  // A place where decoding can start over: the first byte of a gzip member
+  // or of a zstd frame, and the offset of its text in the whole stream.
+  struct RestartPoint {
+    int64_t compressed;
+    int64_t text;
+  };
+
+  class Decoder {
+    protected:
+      std::string filename_;
+      FILE* file_;
+      std::vector<unsigned char> in_;
+      size_t inPos_;
+      size_t inEnd_;
+      int64_t inOffset_;
+
+      // Refills in_ when it is used up; false at the end of the file.
+      bool refill() {
+        if (inPos_ < inEnd_) return true;
+        inOffset_ += inEnd_;
+        inEnd_ = fread(in_.data(), 1, in_.size(), file_);
+        inPos_ = 0;
+        return inEnd_ > 0;
+      }
+      int64_t consumed() const {
+        return inOffset_ + inPos_;
+      }
+      void fail(const char* what) {
+        std::cerr << filename_ << ": " << what << std::endl;
+        exit(EXIT_FAILURE);
+      }
+
+    public:
+      // Restart points known without decoding anything, in text order. More
+      // are appended as decoding crosses them.
+      std::vector<RestartPoint> points;
+
+      Decoder(const std::string& filename, FILE* file, size_t inSize)
+        : filename_(filename), file_(file), in_(inSize), inPos_(0), inEnd_(0), inOffset_(0) {
+        points.push_back({0, 0});
+      }
+      virtual ~Decoder() {
+        fclose(file_);
+      }
+
+      void restart(const RestartPoint& p) {
+        fseeko(file_, p.compressed, SEEK_SET);
+        inOffset_ = p.compressed;
+        inPos_ = 0;
+        inEnd_ = 0;
+        reset();
+      }
+      void reached(int64_t compressed, int64_t text) {
+        if (text > points.back().text) {
+          points.push_back({compressed, text});
+        }
+      }
+
+      virtual void reset() = 0;
+      // Decodes at most n bytes of text starting at offset `text`; returns
+      // 0 at the end of the input only.
+      virtual size_t decode(char* out, size_t n, int64_t text) = 0;
+  };
+
+  // gzip (or zlib) members, one after the other as gzip, pigz -i or bgzip
+  // write them.
+  class GzipDecoder : public Decoder {
+    private:
+      z_stream zs_;
+      bool inMember_;
+
+    public:
+      GzipDecoder(const std::string& filename, FILE* file)
+        : Decoder(filename, file, 1 << 16), inMember_(false) {
+        memset(&zs_, 0, sizeof(zs_));
+        if (inflateInit2(&zs_, 15 + 32) != Z_OK) fail("cannot start gzip decoding");
+      }
+      ~GzipDecoder() {
+        inflateEnd(&zs_);
+      }
+
+      void reset() {
+        inflateReset(&zs_);
+        inMember_ = false;
+      }
+
+      size_t decode(char* out, size_t n, int64_t text) {
+        size_t produced = 0;
+        while (produced < n) {
+          if (!refill()) {
+            if (inMember_) fail("truncated gzip data");
+            break;
+          }
+          zs_.next_in = in_.data() + inPos_;
+          zs_.avail_in = inEnd_ - inPos_;
+          zs_.next_out = (Bytef*) out + produced;
+          zs_.avail_out = n - produced;
+          int ret = inflate(&zs_, Z_NO_FLUSH);
+          inPos_ = inEnd_ - zs_.avail_in;
+          produced = n - zs_.avail_out;
+          if (ret == Z_STREAM_END) {
+            inflateReset(&zs_);
+            inMember_ = false;
+            reached(consumed(), text + produced);
+          } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+            inMember_ = true;
+          } else {
+            fail("corrupt gzip data");
+          }
+        }
+        return produced;
+      }
+  };
+
+#ifdef FASTTEXT_ZSTD
+  // zstd frames. Frames that record their size, as zstd --content-size,
+  // pzstd and the seekable format write them, are all indexed on opening.
+  class ZstdDecoder : public Decoder {
+    private:
+      ZSTD_DStream* zs_;
+      bool inFrame_;
+
+      void index() {
+        MappedFile file;
+        if (!file.open(filename_)) return;
+        const char* p = file.data();
+        int64_t size = file.size(), offset = 0, text = 0;
+        while (offset < size) {
+          size_t frame = ZSTD_findFrameCompressedSize(p + offset, size - offset);
+          unsigned long long content = ZSTD_getFrameContentSize(p + offset, size - offset);
+          if (ZSTD_isError(frame) || content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR) {
+            return;
+          }
+          offset += frame;
+          text += content;
+          reached(offset, text);
+        }
+      }
+
+    public:
+      ZstdDecoder(const std::string& filename, FILE* file)
+        : Decoder(filename, file, ZSTD_DStreamInSize()), inFrame_(false) {
+        zs_ = ZSTD_createDStream();
+        if (zs_ == nullptr) fail("cannot start zstd decoding");
+        index();
+      }
+      ~ZstdDecoder() {
+        ZSTD_freeDStream(zs_);
+      }
+
+      void reset() {
+        ZSTD_DCtx_reset(zs_, ZSTD_reset_session_only);
+        inFrame_ = false;
+      }
+
+      size_t decode(char* out, size_t n, int64_t text) {
+        ZSTD_outBuffer output = {out, n, 0};
+        while (output.pos < n) {
+          if (!refill()) {
+            if (inFrame_) fail("truncated zstd data");
+            break;
+          }
+          ZSTD_inBuffer input = {in_.data(), inEnd_, inPos_};
+          size_t ret = ZSTD_decompressStream(zs_, &output, &input);
+          inPos_ = input.pos;
+          if (ZSTD_isError(ret)) {
+            fail("corrupt zstd data");
+          }
+          inFrame_ = ret != 0;
+          if (ret == 0) {
+            reached(consumed(), text + output.pos);
+          }
+        }
+        return output.pos;
+      }
+  };
+#endif
+
+  // Serves the text of a Decoder in chunks. While the tokenizer reads one
+  // chunk, the next one is decoded on another thread. Each chunk starts
+  // with a copy of the last byte of the one before it, so that a character
+  // can always be put back.
+  class DecodingBuf : public std::streambuf {
+    private:
+      static const size_t CHUNK = 1 << 20;
+
+      std::unique_ptr<Decoder> decoder_;
+      std::vector<char> front_;
+      std::vector<char> back_;
+      std::future<size_t> ahead_;
+      // Text offsets of the chunk in front_ and of the next one.
+      int64_t start_;
+      int64_t next_;
+
+      void decodeAhead() {
+        Decoder* decoder = decoder_.get();
+        char* out = back_.data() + 1;
+        int64_t text = next_;
+        ahead_ = std::async(std::launch::async, [decoder, out, text]() {
+          return decoder->decode(out, CHUNK, text);
+        });
+      }
+
+      // Replaces the front chunk with the one decoded ahead.
+      bool advance() {
+        if (!ahead_.valid()) return false;
+        size_t n = ahead_.get();
+        if (n == 0) return false;
+        back_[0] = egptr() > eback() ? egptr()[-1] : 0;
+        front_.swap(back_);
+        start_ = next_;
+        next_ += n;
+        setg(front_.data(), front_.data() + 1, front_.data() + 1 + n);
+        decodeAhead();
+        return true;
+      }
+
+      void wait() {
+        if (ahead_.valid()) ahead_.get();
+      }
+
+    protected:
+      int_type underflow() {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (!advance()) return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
+      }
+
+      pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+        if (dir == std::ios_base::cur) {
+          return seekpos(start_ + (gptr() - eback() - 1) + off, which);
+        }
+        if (dir == std::ios_base::beg) {
+          return seekpos(off, which);
+        }
+        return pos_type(off_type(-1));
+      }
+
+      // Within the current chunk this only moves the read pointer. Otherwise
+      // decoding restarts at the last restart point before `pos` and skips
+      // the text up to it.
+      pos_type seekpos(pos_type pos, std::ios_base::openmode) {
+        int64_t target = pos;
+        if (target < 0) return pos_type(off_type(-1));
+        if (target >= start_ && (target < next_ || target == start_)) {
+          setg(eback(), eback() + 1 + (target - start_), egptr());
+          return pos;
+        }
+        wait();
+        const std::vector<RestartPoint>& points = decoder_->points;
+        auto it = std::upper_bound(points.begin(), points.end(), target,
+            [](int64_t t, const RestartPoint& p) { return t < p.text; });
+        const RestartPoint p = *(it - 1);
+        decoder_->restart(p);
+        start_ = next_ = p.text;
+        setg(front_.data(), front_.data() + 1, front_.data() + 1);
+        decodeAhead();
+        while (next_ <= target) {
+          if (!advance()) {
+            if (target != next_) return pos_type(off_type(-1));
+            setg(eback(), egptr(), egptr());
+            return pos;
+          }
+        }
+        setg(eback(), eback() + 1 + (target - start_), egptr());
+        return pos;
+      }
+
+    public:
+      explicit DecodingBuf(Decoder* decoder)
+        : decoder_(decoder), front_(CHUNK + 1), back_(CHUNK + 1), start_(0), next_(0) {
+        setg(front_.data(), front_.data() + 1, front_.data() + 1);
+        decodeAhead();
+      }
+      ~DecodingBuf() {
+        wait();
+      }
+  };
+
+}
+
+InputStream::InputStream(const std::string& filename) : std::istream(nullptr) {
+  unsigned char magic[4] = {0, 0, 0, 0};
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == nullptr) {
+    setstate(std::ios_base::failbit);
+    return;
+  }
+  size_t n = fread(magic, 1, 4, file);
+  rewind(file);
+  Decoder* decoder = nullptr;
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    decoder = new GzipDecoder(filename, file);
+  } else if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#ifdef FASTTEXT_ZSTD
+    decoder = new ZstdDecoder(filename, file);
+#else
+    std::cerr << filename << " is zstd compressed, but this build cannot read zstd (make ZSTD=1)." << std::endl;
+    exit(EXIT_FAILURE);
+#endif
+  }
+  if (decoder != nullptr) {
+    buf_.reset(new DecodingBuf(decoder));
+  } else {
+    fclose(file);
+    std::filebuf* buf = new std::filebuf();
+    buf_.reset(buf);
+    buf->open(filename, std::ios_base::in);
+  }
+  rdbuf(buf_.get());
+}
+
+InputStream::~InputStream() {
+  rdbuf(nullptr);
+}
+
+bool InputStream::is_open() const {
+  return buf_ != nullptr;
+}
+
+void InputStream::close() {
+  rdbuf(nullptr);
+  buf_.reset();
+  setstate(std::ios_base::failbit);
+}
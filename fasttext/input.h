@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_INPUT_H
+#define FASTTEXT_INPUT_H
+
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+// A corpus opened by name: plain text, or gzip or zstd data (recognized by
+// their magic bytes, whatever the file is called) decompressed on the fly.
+// Positions are offsets in the decompressed text in every case, so the
+// wrap-around in getLine and the stream positions saved in checkpoints work
+// unchanged. Like an ifstream, a file that cannot be opened leaves the
+// stream failed.
+//
+// zstd is only available when built with ZSTD=1.
+class InputStream : public std::istream {
+  private:
+    std::unique_ptr<std::streambuf> buf_;
+
+  public:
+    explicit InputStream(const std::string&);
+    ~InputStream();
+    InputStream(const InputStream&) = delete;
+    InputStream& operator=(const InputStream&) = delete;
+
+    bool is_open() const;
+    void close();
+};
+
+#endif
@@ -10,30 +10,39 @@
 #include "matrix.h"
 
 #include <assert.h>
+#include <string.h>
 
-#include <random>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
+#include "alloc.h"
+#include "flat.h"
 #include "utils.h"
 #include "vector.h"
 
-Matrix::Matrix() {
+Matrix::Matrix() : account_("matrix") {
   m_ = 0;
   n_ = 0;
+  stride_ = 0;
   data_ = nullptr;
 }
 
-Matrix::Matrix(int64_t m, int64_t n) {
+Matrix::Matrix(int64_t m, int64_t n) : account_("matrix") {
   m_ = m;
   n_ = n;
-  data_ = new real[m * n];
+  stride_ = alloc::rowStride(n);
+  data_ = (real*) alloc::allocate(m * stride_ * sizeof(real));
+  account_.set(m * stride_ * sizeof(real));
 }
 
-Matrix::Matrix(const Matrix& other) {
+Matrix::Matrix(const Matrix& other) : account_(other.account_) {
   m_ = other.m_;
   n_ = other.n_;
-  data_ = new real[m_ * n_];
-  for (int64_t i = 0; i < (m_ * n_); i++) {
-    data_[i] = other.data_[i];
+  stride_ = other.stride_;
+  data_ = (real*) alloc::allocate(m_ * stride_ * sizeof(real));
+  if (data_ != nullptr) {
+    memcpy(data_, other.data_, m_ * stride_ * sizeof(real));
   }
 }
 
@@ -41,34 +50,126 @@ Matrix& Matrix::operator=(const Matrix& other) {
   Matrix temp(other);
   m_ = temp.m_;
   n_ = temp.n_;
+  stride_ = temp.stride_;
   std::swap(data_, temp.data_);
+  std::swap(mapping_, temp.mapping_);
+  account_.set(m_ * stride_ * sizeof(real));
   return *this;
 }
 
 Matrix::~Matrix() {
-  delete[] data_;
+  release();
+}
+
+void Matrix::release() {
+  if (mapping_) {
+    mapping_.reset();
+  } else {
+    alloc::release(data_);
+  }
+  data_ = nullptr;
 }
 
 void Matrix::zero() {
-  for (int64_t i = 0; i < (m_ * n_); i++) {
+  profile::Phase phase("matrix.zero");
+  for (int64_t i = 0; i < (m_ * stride_); i++) {
       data_[i] = 0.0;
   }
 }
 
-void Matrix::uniform(real a) {
-  std::minstd_rand rng(1);
-  std::uniform_real_distribution<> uniform(-a, a);
-  for (int64_t i = 0; i < (m_ * n_); i++) {
-    data_[i] = uniform(rng);
+// Counter-based: the value of a cell is a hash (splitmix64) of its index
+// in the row-major m x n matrix, so it does not depend on how the rows are
+// split between threads, nor on stride_.
+static real uniformAt(uint64_t index, real a) {
+  uint64_t z = index + 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+  return a * (real((z >> 40) * (1.0 / (1 << 24))) * 2 - 1);
+}
+
+// Draws rows [first, last) on `threads` threads, each given a contiguous
+// slice. Each thread calls place(t) first (to bind itself where the rows
+// will be trained, say) and is the first to touch the pages of its slice.
+// The calling thread only does the work itself when there is nothing to
+// place.
+void Matrix::fillUniform(int64_t first, int64_t last, real a, int32_t threads,
+                         const std::function<void(int32_t)>& place) {
+  threads = std::max(int64_t(1), std::min(int64_t(threads), last - first));
+  auto fill = [this, first, last, a, threads, &place](int32_t t) {
+    if (place) place(t);
+    int64_t begin = first + (last - first) * t / threads;
+    int64_t end = first + (last - first) * (t + 1) / threads;
+    for (int64_t i = begin; i < end; i++) {
+      real* row = data_ + i * stride_;
+      for (int64_t j = 0; j < n_; j++) {
+        row[j] = uniformAt(i * n_ + j, a);
+      }
+    }
+  };
+  if (threads == 1 && !place) {
+    fill(0);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int32_t t = 0; t < threads; t++) {
+    workers.push_back(std::thread(fill, t));
+  }
+  for (auto& w : workers) {
+    w.join();
   }
 }
 
+void Matrix::uniform(real a, int32_t threads, const std::function<void(int32_t)>& place) {
+  profile::Phase phase("matrix.uniform");
+  fillUniform(0, m_, a, threads, place);
+}
+
+// Appends rows up to `m`, keeping the existing ones where they are. New rows
+// are drawn from uniform(-a, a) as uniform() would have drawn them, or left
+// at zero when a is 0.
+void Matrix::grow(int64_t m, real a, int32_t threads, const std::function<void(int32_t)>& place) {
+  assert(m >= m_);
+  if (m == m_) return;
+  real* data = (real*) alloc::allocate(m * stride_ * sizeof(real));
+  if (data_ != nullptr) {
+    memcpy(data, data_, m_ * stride_ * sizeof(real));
+  }
+  release();
+  data_ = data;
+  int64_t old = m_;
+  m_ = m;
+  account_.set(m_ * stride_ * sizeof(real));
+  if (a != 0) {
+    fillUniform(old, m_, a, threads, place);
+  }
+}
+
+// Rows written here are flagged in dirty_ when it is in use (data-parallel
+// workers send only those rows).
 void Matrix::addRow(const Vector& vec, int64_t i, real a) {
+  assert(vec.m_ == n_);
+  addRow(vec.data_, i, a);
+}
+
+void Matrix::addRow(const real* vec, int64_t i, real a) {
   assert(i >= 0);
   assert(i < m_);
-  assert(vec.m_ == n_);
+  if (!dirty_.empty()) {
+    dirty_[i] = 1;
+  }
+  real* row = data_ + i * stride_;
   for (int64_t j = 0; j < n_; j++) {
-    data_[i * n_ + j] += a * vec.data_[j];
+    row[j] += a * vec[j];
+  }
+}
+
+// Brings every cache line of row i towards the cache, for writing.
+void Matrix::prefetchRow(int64_t i) const {
+  const char* row = (const char*) (data_ + i * stride_);
+  const int64_t bytes = n_ * sizeof(real);
+  for (int64_t b = 0; b < bytes; b += alloc::CACHE_LINE) {
+    __builtin_prefetch(row + b, 1, 3);
   }
 }
 
@@ -76,23 +177,67 @@ real Matrix::dotRow(const Vector& vec, int64_t i) {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.m_ == n_);
+  const real* row = data_ + i * stride_;
   real d = 0.0;
   for (int64_t j = 0; j < n_; j++) {
-    d += data_[i * n_ + j] * vec.data_[j];
+    d += row[j] * vec.data_[j];
   }
   return d;
 }
 
+// The file holds the rows without their padding.
 void Matrix::save(std::ostream& out) {
   out.write((char*) &m_, sizeof(int64_t));
   out.write((char*) &n_, sizeof(int64_t));
-  out.write((char*) data_, m_ * n_ * sizeof(real));
+  if (stride_ == n_) {
+    out.write((char*) data_, m_ * n_ * sizeof(real));
+    return;
+  }
+  for (int64_t i = 0; i < m_; i++) {
+    out.write((char*) (data_ + i * stride_), n_ * sizeof(real));
+  }
 }
 
 void Matrix::load(std::istream& in) {
   in.read((char*) &m_, sizeof(int64_t));
   in.read((char*) &n_, sizeof(int64_t));
-  delete[] data_;
-  data_ = new real[m_ * n_];
-  in.read((char*) data_, m_ * n_ * sizeof(real));
+  release();
+  stride_ = alloc::rowStride(n_);
+  data_ = (real*) alloc::allocate(m_ * stride_ * sizeof(real));
+  account_.set(m_ * stride_ * sizeof(real));
+  if (stride_ == n_) {
+    in.read((char*) data_, m_ * n_ * sizeof(real));
+    return;
+  }
+  for (int64_t i = 0; i < m_; i++) {
+    in.read((char*) (data_ + i * stride_), n_ * sizeof(real));
+  }
+}
+
+// Reads the m x n rows at `data`, inside `mapping`, in place.
+void Matrix::view(std::shared_ptr<MappedFile> mapping, const real* data, int64_t m, int64_t n) {
+  release();
+  mapping_ = mapping;
+  data_ = const_cast<real*>(data);
+  m_ = m;
+  n_ = n;
+  stride_ = n;
+  account_.set(0);
+}
+
+// The first offset from `pos` at which the rows of a saved matrix, after
+// its two int64 dimensions, start on a cache line.
+int64_t Matrix::alignedOffset(int64_t pos) {
+  const int64_t header = 2 * sizeof(int64_t);
+  return (pos + header + alloc::CACHE_LINE - 1) / alloc::CACHE_LINE * alloc::CACHE_LINE - header;
+}
+
+void Matrix::savePadding(std::ostream& out) {
+  const char zeros[alloc::CACHE_LINE] = {0};
+  int64_t pos = out.tellp();
+  out.write(zeros, alignedOffset(pos) - pos);
+}
+
+void Matrix::skipPadding(std::istream& in) {
+  in.seekg(alignedOffset(in.tellg()));
 }
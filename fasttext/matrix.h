@@ -11,19 +11,39 @@
 #define FASTTEXT_MATRIX_H
 
 #include <cstdint>
+#include <functional>
 #include <istream>
+#include <memory>
 #include <ostream>
+#include <vector>
 
+#include "profile.h"
 #include "real.h"
 
+class MappedFile;
 class Vector;
 
+// Rows are stride_ reals apart (see alloc::rowStride), so that each one
+// starts on a cache line; the reals past n_ in a row stay zero. Bulk loops
+// may run over all m_ * stride_ reals. A new matrix is all zeros.
+//
+// A view (see view()) reads its rows in place from a mapped file instead:
+// its rows are n_ reals apart, and it must not be written.
 class Matrix {
+  private:
+    std::shared_ptr<MappedFile> mapping_;
+
+    void fillUniform(int64_t, int64_t, real, int32_t, const std::function<void(int32_t)>&);
+    void release();
+
 
   public:
     real* data_;
     int64_t m_;
     int64_t n_;
+    int64_t stride_;
+    profile::Account account_;
+    std::vector<uint8_t> dirty_;
 
     Matrix();
     Matrix(int64_t, int64_t);
@@ -32,12 +52,22 @@ class Matrix {
     ~Matrix();
 
     void zero();
-    void uniform(real);
+    void uniform(real, int32_t = 1, const std::function<void(int32_t)>& = nullptr);
+    void grow(int64_t, real, int32_t = 1, const std::function<void(int32_t)>& = nullptr);
     real dotRow(const Vector&, int64_t);
     void addRow(const Vector&, int64_t, real);
+    void addRow(const real*, int64_t, real);
+    void prefetchRow(int64_t) const;
 
     void save(std::ostream&);
     void load(std::istream&);
+    void view(std::shared_ptr<MappedFile>, const real*, int64_t, int64_t);
+
+    // Model files from version 2 on pad before each matrix, so that its
+    // rows start on a cache line of the file, where view() can read them.
+    static int64_t alignedOffset(int64_t);
+    static void savePadding(std::ostream&);
+    static void skipPadding(std::istream&);
 };
 
 #endif
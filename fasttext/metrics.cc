@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "metrics.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+Metrics::Metrics(std::shared_ptr<Args> args) {
+  args_ = args;
+  running_ = false;
+  lastTime_ = 0.0;
+  start_ = std::chrono::steady_clock::now();
+}
+
+Metrics::~Metrics() {
+  stop();
+}
+
+MetricsSlot* Metrics::registerSlot(const std::string& task, int32_t threadId,
+                                   double lr, int64_t targetTokens) {
+  std::unique_ptr<MetricsSlot> slot(new MetricsSlot());
+  slot->task = task;
+  slot->threadId = threadId;
+  slot->lr = lr;
+  slot->targetTokens = targetTokens;
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_.push_back(std::move(slot));
+  return slots_.back().get();
+}
+
+// Tokens trained so far over all slots.
+int64_t Metrics::tokens() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t total = 0;
+  for (auto& slot : slots_) {
+    total += slot->tokens.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+// Fraction of the tokens to train trained so far, over all slots.
+double Metrics::progress() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t tokens = 0, target = 0;
+  for (auto& slot : slots_) {
+    tokens += slot->tokens.load(std::memory_order_relaxed);
+    target += slot->targetTokens;
+  }
+  return target > 0 ? std::min(1.0, double(tokens) / target) : 0.0;
+}
+
+void Metrics::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) return;
+  if (!args_->metrics.empty() && args_->metricsFormat == "json") {
+    json_.open(args_->metrics);
+    if (!json_.is_open()) {
+      std::cerr << "Metrics file cannot be opened for writing!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  start_ = std::chrono::steady_clock::now();
+  running_ = true;
+  reporter_ = std::thread([this]() { run(); });
+}
+
+void Metrics::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  reporter_.join();
+  report(true);
+  if (json_.is_open()) json_.close();
+}
+
+void Metrics::run() {
+  auto interval = std::chrono::duration<double>(args_->metricsInterval);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    cv_.wait_for(lock, interval);
+    if (!running_) break;
+    lock.unlock();
+    report(false);
+    lock.lock();
+  }
+}
+
+void Metrics::report(bool final) {
+  double now = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_).count();
+  std::vector<Sample> samples;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& s : slots_) {
+      Sample x;
+      x.slot = s.get();
+      x.tokens = s->tokens.load(std::memory_order_relaxed);
+      x.examples = s->examples.load(std::memory_order_relaxed);
+      x.loss = s->loss.load(std::memory_order_relaxed);
+      x.negativesRejected = s->negativesRejected.load(std::memory_order_relaxed);
+      samples.push_back(x);
+    }
+  }
+  if (samples.empty()) return;
+
+  if (args_->verbose > 1) {
+    printProgress(now, samples);
+    printHistory(samples);
+    if (final) std::cerr << std::endl;
+  }
+  if (json_.is_open()) writeJson(now, samples);
+  if (!args_->metrics.empty() && args_->metricsFormat == "prom") writeProm(samples);
+
+  last_ = samples;
+  lastTime_ = now;
+}
+
+// Slots are only ever appended, so samples[i] and last_[i] describe the same
+// slot for every i < last_.size().
+void Metrics::printProgress(double now, const std::vector<Sample>& samples) {
+  int64_t tokens = 0, target = 0, delta = 0;
+  double loss = 0.0;
+  int64_t examples = 0;
+  std::set<int32_t> threads;
+  for (size_t i = 0; i < samples.size(); i++) {
+    tokens += samples[i].tokens;
+    target += samples[i].slot->targetTokens;
+    delta += samples[i].tokens - (i < last_.size() ? last_[i].tokens : 0);
+    loss += samples[i].loss;
+    examples += samples[i].examples;
+    threads.insert(samples[i].slot->threadId);
+  }
+  double progress = target > 0 ? std::min(1.0, double(tokens) / target) : 0.0;
+  double dt = now - lastTime_;
+  double wst = dt > 0 ? delta / dt / threads.size() : 0.0;
+  int eta = progress > 0 ? int(now / progress * (1 - progress)) : 0;
+  int etah = eta / 3600;
+  int etam = (eta - etah * 3600) / 60;
+  std::cerr << std::fixed;
+  std::cerr << "\rProgress: " << std::setprecision(1) << 100 * progress << "%";
+  std::cerr << "  words/sec/thread: " << std::setprecision(0) << wst;
+  std::cerr << "  loss: " << std::setprecision(6) << (examples > 0 ? loss / examples : 0.0);
+  std::cerr << "  eta: " << etah << "h" << etam << "m ";
+  std::cerr << std::flush;
+}
+
+// One `name|progress|lr|loss` line per task on stdout, the format the
+// plotting scripts in tests/ read.
+void Metrics::printHistory(const std::vector<Sample>& samples) {
+  std::map<std::string, std::vector<size_t>> tasks;
+  for (size_t i = 0; i < samples.size(); i++) {
+    tasks[samples[i].slot->task].push_back(i);
+  }
+  std::ostringstream out;
+  for (auto& t : tasks) {
+    int64_t tokens = 0, target = 0, examples = 0;
+    double loss = 0.0;
+    for (size_t i : t.second) {
+      tokens += samples[i].tokens;
+      target += samples[i].slot->targetTokens;
+      examples += samples[i].examples;
+      loss += samples[i].loss;
+    }
+    double progress = target > 0 ? std::min(1.0, double(tokens) / target) : 0.0;
+    double lr = args_->schedule(samples[t.second[0]].slot->lr, progress);
+    out << t.first << "|" << progress << "|" << lr << "|"
+        << (examples > 0 ? loss / examples : 0.0) << "\n";
+  }
+  std::cout << out.str() << std::flush;
+}
+
+void Metrics::writeJson(double now, const std::vector<Sample>& samples) {
+  double dt = now - lastTime_;
+  for (size_t i = 0; i < samples.size(); i++) {
+    const MetricsSlot& s = *samples[i].slot;
+    const Sample& x = samples[i];
+    int64_t delta = x.tokens - (i < last_.size() ? last_[i].tokens : 0);
+    double progress = s.targetTokens > 0 ? std::min(1.0, double(x.tokens) / s.targetTokens) : 0.0;
+    json_ << "{\"time\": " << now
+          << ", \"task\": \"" << s.task << "\""
+          << ", \"thread\": " << s.threadId
+          << ", \"progress\": " << progress
+          << ", \"lr\": " << args_->schedule(s.lr, progress)
+          << ", \"tokens\": " << x.tokens
+          << ", \"tokens_per_sec\": " << (dt > 0 ? delta / dt : 0.0)
+          << ", \"examples\": " << x.examples
+          << ", \"loss_sum\": " << x.loss
+          << ", \"negatives_rejected\": " << x.negativesRejected
+          << "}\n";
+  }
+  json_.flush();
+}
+
+void Metrics::writeProm(const std::vector<Sample>& samples) {
+  std::string tmp = args_->metrics + ".tmp";
+  std::ofstream ofs(tmp);
+  if (!ofs.is_open()) {
+    std::cerr << "Metrics file cannot be opened for writing!" << std::endl;
+    return;
+  }
+  struct Family {
+    const char* name;
+    const char* type;
+    const char* help;
+  };
+  const Family families[] = {
+    {"biltext_tokens_total", "counter", "Tokens read by the training thread."},
+    {"biltext_examples_total", "counter", "Model updates performed."},
+    {"biltext_loss_sum", "counter", "Sum of the training loss over all examples."},
+    {"biltext_negatives_rejected_total", "counter", "Negative samples rejected by the language mask."},
+    {"biltext_progress", "gauge", "Fraction of the schedule completed."},
+  };
+  for (int32_t f = 0; f < 5; f++) {
+    ofs << "# HELP " << families[f].name << " " << families[f].help << "\n";
+    ofs << "# TYPE " << families[f].name << " " << families[f].type << "\n";
+    for (size_t i = 0; i < samples.size(); i++) {
+      const MetricsSlot& s = *samples[i].slot;
+      const Sample& x = samples[i];
+      ofs << families[f].name << "{task=\"" << s.task << "\",thread=\"" << s.threadId << "\"} ";
+      switch (f) {
+        case 0: ofs << x.tokens; break;
+        case 1: ofs << x.examples; break;
+        case 2: ofs << x.loss; break;
+        case 3: ofs << x.negativesRejected; break;
+        case 4: ofs << (s.targetTokens > 0 ? std::min(1.0, double(x.tokens) / s.targetTokens) : 0.0); break;
+      }
+      ofs << "\n";
+    }
+  }
+  ofs.close();
+  rename(tmp.c_str(), args_->metrics.c_str());
+}
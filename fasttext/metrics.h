@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_METRICS_H
+#define FASTTEXT_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "args.h"
+#include "real.h"
+
+// Counters of one (task, thread) pair. Each slot is written by exactly one
+// training thread, so updates are a relaxed load + store rather than a locked
+// read-modify-write; the reporter thread only ever loads.
+struct alignas(64) MetricsSlot {
+  std::string task;
+  int32_t threadId;
+  double lr;
+  int64_t targetTokens;
+
+  std::atomic<int64_t> tokens{0};
+  std::atomic<int64_t> examples{0};
+  std::atomic<double> loss{0.0};
+  std::atomic<int64_t> negativesRejected{0};
+
+  template<typename T>
+  static void add(std::atomic<T>& counter, T x) {
+    counter.store(counter.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+  }
+};
+
+class Metrics {
+  private:
+    std::shared_ptr<Args> args_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::unique_ptr<MetricsSlot>> slots_;
+    std::thread reporter_;
+    bool running_;
+    std::chrono::steady_clock::time_point start_;
+    std::ofstream json_;
+
+    struct Sample {
+      const MetricsSlot* slot;
+      int64_t tokens;
+      int64_t examples;
+      double loss;
+      int64_t negativesRejected;
+    };
+    std::vector<Sample> last_;
+    double lastTime_;
+
+    void run();
+    void report(bool);
+    void printProgress(double, const std::vector<Sample>&);
+    void printHistory(const std::vector<Sample>&);
+    void writeJson(double, const std::vector<Sample>&);
+    void writeProm(const std::vector<Sample>&);
+
+  public:
+    explicit Metrics(std::shared_ptr<Args>);
+    ~Metrics();
+
+    MetricsSlot* registerSlot(const std::string&, int32_t, double, int64_t);
+    int64_t tokens();
+    double progress();
+    void start();
+    void stop();
+};
+
+#endif
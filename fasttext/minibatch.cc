@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "minibatch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "gemm.h"
+#include "model.h"
+#include "utils.h"
+
+MiniBatch::MiniBatch(Model& model, std::shared_ptr<Args> args, int32_t size)
+  : model_(model), args_(args), size_(size), dim_(args->dim), nscored_(0),
+    account_("model.minibatch") {
+  if (args_->loss != loss_name::ns && args_->loss != loss_name::softmax) {
+    std::cerr << "Mini-batches need the ns or softmax loss." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  pairs_.reserve(size_);
+  inputOffsets_.push_back(0);
+}
+
+void MiniBatch::add(id_range input, int32_t target, real lr) {
+  int32_t ninputs = inputOffsets_.size() - 1;
+  if (ninputs == 0 || !std::equal(input.cbegin(), input.cend(),
+                                  inputIds_.begin() + inputOffsets_[ninputs - 1], inputIds_.end())) {
+    inputIds_.insert(inputIds_.end(), input.cbegin(), input.cend());
+    inputOffsets_.push_back(inputIds_.size());
+    ninputs++;
+  }
+  pairs_.push_back({ninputs - 1, target, lr});
+  if (pairs_.size() >= size_) {
+    flush();
+  }
+}
+
+int32_t MiniBatch::addColumn(int32_t row) {
+  auto it = column_.emplace(row, int32_t(rows_.size()));
+  if (it.second) {
+    rows_.push_back(row);
+  }
+  return it.first->second;
+}
+
+// `neg` negatives per language among the targets, drawn as getNegative
+// would for the first target of that language. Every pair is then scored
+// against the negatives of its target's language, but not against its own
+// target should it be one of them. A row drawn twice is kept once and
+// weighed twice.
+void MiniBatch::sampleNegatives() {
+  langs_.clear();
+  std::vector<char> seen;
+  for (const Pair& pair : pairs_) {
+    char lang = model_.lang_mask_[pair.target];
+    if (std::find(seen.begin(), seen.end(), lang) != seen.end()) continue;
+    seen.push_back(lang);
+    for (int32_t n = 0; n < args_->neg; n++) {
+      int32_t c = addColumn(model_.getNegative(pair.target));
+      if (c == langs_.size()) {
+        langs_.push_back(lang);
+        counts_.push_back(1.0);
+      } else {
+        counts_[c] += 1.0;
+      }
+    }
+  }
+}
+
+// hidden_ holds the mean input row of each input, weights_ a copy of each
+// output row of the group.
+void MiniBatch::gather() {
+  int32_t ninputs = inputOffsets_.size() - 1;
+  hidden_.assign(int64_t(ninputs) * dim_, 0.0);
+  for (int32_t i = 0; i < ninputs; i++) {
+    real* h = hidden_.data() + int64_t(i) * dim_;
+    int64_t first = inputOffsets_[i], last = inputOffsets_[i + 1];
+    for (int64_t j = first; j < last; j++) {
+      int32_t id = inputIds_[j];
+      const Matrix& wi = id < model_.hotIn_.m_ ? model_.hotIn_ : *model_.wi_;
+      const real* row = wi.data_ + int64_t(id) * wi.stride_;
+      for (int32_t d = 0; d < dim_; d++) {
+        h[d] += row[d];
+      }
+    }
+    real scale = 1.0 / (last - first);
+    for (int32_t d = 0; d < dim_; d++) {
+      h[d] *= scale;
+    }
+  }
+  weights_.resize(rows_.size() * int64_t(dim_));
+  for (size_t c = 0; c < rows_.size(); c++) {
+    int32_t id = rows_[c];
+    const Matrix& wo = id < model_.hotOut_.m_ ? model_.hotOut_ : *model_.wo_;
+    const real* row = wo.data_ + int64_t(id) * wo.stride_;
+    std::copy(row, row + dim_, weights_.data() + c * dim_);
+  }
+}
+
+// Fills alphas_ (scored rows x inputs) with the summed negative gradients
+// scales and folds the positive ones into grad_ and outputGrad_ directly.
+// Returns the summed loss of the pairs.
+real MiniBatch::scoreNegatives() {
+  int32_t ninputs = inputOffsets_.size() - 1;
+  int32_t npairs = pairs_.size();
+  utils::sigmoid_n(scores_.data(), scores_.data(), scores_.size());
+  losses_.resize(scores_.size());
+  for (size_t j = 0; j < scores_.size(); j++) {
+    losses_[j] = 1.0 - scores_[j];
+  }
+  utils::log_n(losses_.data(), losses_.data(), losses_.size());
+
+  positives_.resize(npairs);
+  for (int32_t b = 0; b < npairs; b++) {
+    const real* h = hidden_.data() + int64_t(pairs_[b].input) * dim_;
+    const real* w = weights_.data() + int64_t(column_[pairs_[b].target]) * dim_;
+    real s = 0.0;
+    for (int32_t d = 0; d < dim_; d++) {
+      s += h[d] * w[d];
+    }
+    positives_[b] = s;
+  }
+  utils::sigmoid_n(positives_.data(), positives_.data(), npairs);
+
+  real loss = 0.0;
+  for (int32_t b = 0; b < npairs; b++) {
+    const Pair& pair = pairs_[b];
+    int32_t i = pair.input;
+    int32_t c = column_[pair.target];
+    real alpha = pair.lr * (1.0 - positives_[b]);
+    real* g = grad_.data() + int64_t(i) * dim_;
+    real* og = outputGrad_.data() + int64_t(c) * dim_;
+    const real* h = hidden_.data() + int64_t(i) * dim_;
+    const real* w = weights_.data() + int64_t(c) * dim_;
+    for (int32_t d = 0; d < dim_; d++) {
+      g[d] += alpha * w[d];
+      og[d] += alpha * h[d];
+    }
+    char lang = model_.lang_mask_[pair.target];
+    for (int32_t k = 0; k < nscored_; k++) {
+      if (rows_[k] == pair.target || langs_[k] != lang) continue;
+      int64_t j = int64_t(k) * ninputs + i;
+      alphas_[j] -= pair.lr * counts_[k] * scores_[j];
+      loss -= counts_[k] * losses_[j];
+    }
+  }
+  utils::log_n(positives_.data(), positives_.data(), npairs);
+  for (int32_t b = 0; b < npairs; b++) {
+    loss -= positives_[b];
+  }
+  return loss;
+}
+
+// A softmax over every label for each input; fills alphas_ and returns the
+// summed loss of the pairs.
+real MiniBatch::scoreSoftmax() {
+  int32_t ninputs = inputOffsets_.size() - 1;
+  int32_t npairs = pairs_.size();
+  losses_.resize(nscored_);
+  for (int32_t i = 0; i < ninputs; i++) {
+    real max = scores_[i], z = 0.0;
+    for (int32_t k = 0; k < nscored_; k++) {
+      max = std::max(max, scores_[int64_t(k) * ninputs + i]);
+    }
+    for (int32_t k = 0; k < nscored_; k++) {
+      losses_[k] = scores_[int64_t(k) * ninputs + i] - max;
+    }
+    utils::exp_n(losses_.data(), losses_.data(), nscored_);
+    for (int32_t k = 0; k < nscored_; k++) {
+      z += losses_[k];
+    }
+    for (int32_t k = 0; k < nscored_; k++) {
+      scores_[int64_t(k) * ninputs + i] = losses_[k] / z;
+    }
+  }
+  positives_.resize(npairs);
+  for (int32_t b = 0; b < npairs; b++) {
+    const Pair& pair = pairs_[b];
+    int32_t t = column_[pair.target];
+    for (int32_t k = 0; k < nscored_; k++) {
+      int64_t j = int64_t(k) * ninputs + pair.input;
+      real label = (k == t) ? 1.0 : 0.0;
+      alphas_[j] += pair.lr * (label - scores_[j]);
+    }
+    positives_[b] = scores_[int64_t(t) * ninputs + pair.input];
+  }
+  utils::log_n(positives_.data(), positives_.data(), npairs);
+  real loss = 0.0;
+  for (int32_t b = 0; b < npairs; b++) {
+    loss -= positives_[b];
+  }
+  return loss;
+}
+
+// Adds the summed gradient of every distinct row to its matrix once.
+void MiniBatch::scatter() {
+  for (size_t c = 0; c < rows_.size(); c++) {
+    int32_t id = rows_[c];
+    Matrix& wo = id < model_.hotOut_.m_ ? model_.hotOut_ : *model_.wo_;
+    wo.addRow(outputGrad_.data() + c * dim_, id, 1.0);
+  }
+
+  int32_t ninputs = inputOffsets_.size() - 1;
+  inputSlot_.clear();
+  std::vector<int32_t>& ids = inputRows_;
+  ids.clear();
+  for (int32_t i = 0; i < ninputs; i++) {
+    int64_t first = inputOffsets_[i], last = inputOffsets_[i + 1];
+    real scale = args_->model == model_name::sup ? 1.0 / (last - first) : 1.0;
+    const real* g = grad_.data() + int64_t(i) * dim_;
+    for (int64_t j = first; j < last; j++) {
+      auto it = inputSlot_.emplace(inputIds_[j], int32_t(ids.size()));
+      if (it.second) {
+        ids.push_back(inputIds_[j]);
+        inputGrad_.resize(ids.size() * int64_t(dim_));
+        std::fill(inputGrad_.end() - dim_, inputGrad_.end(), 0.0);
+      }
+      real* acc = inputGrad_.data() + int64_t(it.first->second) * dim_;
+      for (int32_t d = 0; d < dim_; d++) {
+        acc[d] += scale * g[d];
+      }
+    }
+  }
+  for (size_t s = 0; s < ids.size(); s++) {
+    int32_t id = ids[s];
+    Matrix& wi = id < model_.hotIn_.m_ ? model_.hotIn_ : *model_.wi_;
+    wi.addRow(inputGrad_.data() + s * dim_, id, 1.0);
+  }
+}
+
+void MiniBatch::track() {
+  int64_t bytes = 0;
+  for (auto* v : {&hidden_, &weights_, &scores_, &alphas_, &losses_, &grad_, &outputGrad_, &inputGrad_}) {
+    bytes += v->capacity() * sizeof(real);
+  }
+  bytes += inputIds_.capacity() * sizeof(int32_t) + pairs_.capacity() * sizeof(Pair);
+  if (bytes != account_.bytes()) {
+    account_.set(bytes);
+  }
+}
+
+void MiniBatch::flush() {
+  if (pairs_.empty()) return;
+  int32_t ninputs = inputOffsets_.size() - 1;
+  int32_t npairs = pairs_.size();
+  bool ns = args_->loss == loss_name::ns;
+
+  rows_.clear();
+  column_.clear();
+  counts_.clear();
+  if (ns) {
+    sampleNegatives();
+  } else {
+    for (int32_t k = 0; k < model_.osz_; k++) {
+      addColumn(k);
+    }
+  }
+  nscored_ = rows_.size();
+  for (const Pair& pair : pairs_) {
+    addColumn(pair.target);
+  }
+  gather();
+
+  // scores = weights[:nscored] . hidden^T, one row per scored output row.
+  scores_.assign(int64_t(nscored_) * ninputs, 0.0);
+  gemm::multiply(false, true, nscored_, ninputs, dim_, 1.0, weights_.data(), dim_,
+                 hidden_.data(), dim_, scores_.data(), ninputs);
+
+  alphas_.assign(scores_.size(), 0.0);
+  grad_.assign(int64_t(ninputs) * dim_, 0.0);
+  outputGrad_.assign(rows_.size() * int64_t(dim_), 0.0);
+  real loss = ns ? scoreNegatives() : scoreSoftmax();
+
+  // grad += alphas^T . weights[:nscored], outputGrad[:nscored] += alphas . hidden
+  gemm::multiply(true, false, ninputs, dim_, nscored_, 1.0, alphas_.data(), ninputs,
+                 weights_.data(), dim_, grad_.data(), dim_);
+  gemm::multiply(false, false, nscored_, dim_, ninputs, 1.0, alphas_.data(), ninputs,
+                 hidden_.data(), dim_, outputGrad_.data(), dim_);
+  scatter();
+
+  model_.loss_ += loss;
+  model_.nexamples_ += npairs;
+  if (model_.metrics_ != nullptr) {
+    MetricsSlot::add(model_.metrics_->examples, int64_t(npairs));
+    MetricsSlot::add(model_.metrics_->loss, double(loss));
+  }
+  track();
+  pairs_.clear();
+  inputIds_.clear();
+  inputOffsets_.resize(1);
+
+  if (model_.hotOut_.m_ + model_.hotIn_.m_ > 0) {
+    int64_t syncs = model_.hotSteps_ / args_->hotSync;
+    model_.hotSteps_ += npairs;
+    if (model_.hotSteps_ / args_->hotSync != syncs) {
+      model_.mergeHotRows();
+    }
+  }
+}
+
+// Rough size of the buffers of one group over `osz` outputs, counting 16
+// ids per input when words have subwords.
+int64_t MiniBatch::estimateMemory(std::shared_ptr<Args> args, int64_t osz) {
+  int64_t size = args->batch;
+  int64_t ids = size * (args->maxn > 0 ? 16 : 1);
+  int64_t scored = args->loss == loss_name::ns ? 2 * args->neg : osz;
+  int64_t rows = scored + size;
+  int64_t reals = (2 * size + ids + 2 * rows) * args->dim + 3 * scored * size;
+  return reals * sizeof(real) + ids * sizeof(int32_t) + size * sizeof(Pair);
+}
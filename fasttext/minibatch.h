@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_MINIBATCH_H
+#define FASTTEXT_MINIBATCH_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "profile.h"
+#include "real.h"
+
+class Model;
+
+// -batch_*: trains a Model on groups of (input, target) pairs instead of one
+// pair at a time. The hidden vectors of the pending inputs are gathered
+// into a matrix and scored against the output rows of the group with
+// gemm::multiply: the negatives shared by the whole group for ns, every
+// label for softmax. Gradients are summed per distinct row before they
+// reach the shared matrices, so every row is written once per group.
+//
+// All the hidden vectors and scores of a group are computed from the
+// weights at the time it is flushed, so a pair does not see the updates of
+// the pairs queued before it in the same group.
+class MiniBatch {
+  private:
+    Model& model_;
+    std::shared_ptr<Args> args_;
+    int32_t size_;
+    int32_t dim_;
+
+    // Pending pairs. Consecutive pairs with the same input (the contexts of
+    // one skipgram center) share one entry of inputs_.
+    struct Pair {
+      int32_t input;
+      int32_t target;
+      real lr;
+    };
+    std::vector<Pair> pairs_;
+    std::vector<int32_t> inputIds_;
+    std::vector<int64_t> inputOffsets_;
+
+    // Output rows of the group: the first nscored_ are scored with the GEMM
+    // (shared negatives or all labels), the others are targets only
+    // reached through their pair. langs_ and counts_ are the language and
+    // the number of draws of each negative.
+    std::vector<int32_t> rows_;
+    std::unordered_map<int32_t, int32_t> column_;
+    int32_t nscored_;
+    std::vector<char> langs_;
+    std::vector<real> counts_;
+
+    std::vector<real> hidden_;
+    std::vector<real> weights_;
+    std::vector<real> scores_;
+    std::vector<real> alphas_;
+    std::vector<real> positives_;
+    std::vector<real> losses_;
+    std::vector<real> grad_;
+    std::vector<real> outputGrad_;
+    std::unordered_map<int32_t, int32_t> inputSlot_;
+    std::vector<int32_t> inputRows_;
+    std::vector<real> inputGrad_;
+    profile::Account account_;
+
+    int32_t addColumn(int32_t);
+    void sampleNegatives();
+    void gather();
+    real scoreNegatives();
+    real scoreSoftmax();
+    void scatter();
+    void track();
+
+  public:
+    MiniBatch(Model&, std::shared_ptr<Args>, int32_t);
+
+    void add(id_range, int32_t, real);
+    void flush();
+    static int64_t estimateMemory(std::shared_ptr<Args>, int64_t);
+};
+
+#endif
@@ -10,11 +10,16 @@
 #include "model.h"
 #include <assert.h>
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include "alloc.h"
 #include "utils.h"
 
 Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo, std::shared_ptr<Args> args, int32_t seed)
-  : hidden_(args->dim), output_(wo->m_), grad_(args->dim), rng(seed)
+  : hidden_(args->dim), output_(wo->m_), grad_(args->dim),
+    negativesAccount_("model.negatives"), treeAccount_("model.tree"),
+    buffersAccount_("model.buffers"), rng(seed)
 {
   wi_ = wi;
   wo_ = wo;
@@ -25,42 +30,105 @@ Model::Model(std::shared_ptr<Matrix> wi, std::shared_ptr<Matrix> wo, std::shared
   negpos = 0;
   loss_ = 0.0;
   nexamples_ = 1;
+  metrics_ = nullptr;
+  buffersAccount_.set((hidden_.m_ + output_.m_ + grad_.m_) * sizeof(real));
+  hotSteps_ = 0;
+  if (args_->hotRows > 0 && args_->loss == loss_name::ns) {
+    initHotRows(*wo_, hotOut_, hotOutBase_);
+  }
+  if (args_->hotRows > 0 && args_->hotInput) {
+    initHotRows(*wi_, hotIn_, hotInBase_);
+  }
+  if (args_->batch > 0) {
+    batch_.reset(new MiniBatch(*this, args_, args_->batch));
+  }
 }
 
-real Model::binaryLogistic(int32_t target, bool label, real lr) {
-  real score = utils::sigmoid(wo_->dotRow(hidden_, target));
-  real alpha = lr * (real(label) - score);
-  grad_.addRow(*wo_, target, alpha);
-  wo_->addRow(hidden_, target, alpha);
-  if (label) {
-    return -utils::log(score);
-  } else {
-    return -utils::log(1.0 - score);
+// -hotRows: private copies of the first rows of a shared matrix, i.e. of the
+// most frequent words since the dictionary is sorted by count. Updates to
+// those rows stay in `local` and only their difference to `base` (the
+// shared values at the last merge) is added to the shared matrix every
+// -hotSync updates, so threads stop fighting over the same cache lines on
+// every example. The copies belong to this Model, i.e. to one task of one
+// thread: a thread training the four bilingual tasks holds four of them.
+void Model::initHotRows(const Matrix& shared, Matrix& local, Matrix& base) {
+  int64_t k = std::min(int64_t(args_->hotRows), shared.m_);
+  local.account_.rename("model.hotRows");
+  base.account_.rename("model.hotRows");
+  local = Matrix(k, shared.n_);
+  base = Matrix(k, shared.n_);
+  for (int64_t i = 0; i < k; i++) {
+    const real* row = shared.data_ + i * shared.stride_;
+    std::memcpy(local.data_ + i * local.stride_, row, shared.n_ * sizeof(real));
   }
+  std::memcpy(base.data_, local.data_, k * local.stride_ * sizeof(real));
 }
 
-real Model::negativeSampling(int32_t target, real lr) {
+void Model::syncHotRows(Matrix& shared, Matrix& local, Matrix& base) {
+  if (!shared.dirty_.empty()) {
+    std::fill(shared.dirty_.begin(), shared.dirty_.begin() + local.m_, 1);
+  }
+  for (int64_t i = 0; i < (local.m_ * local.stride_); i++) {
+    real x = shared.data_[i] + local.data_[i] - base.data_[i];
+    shared.data_[i] = x;
+    local.data_[i] = x;
+    base.data_[i] = x;
+  }
+}
+
+// Also called by the trainer after its last step and before it hands its
+// state to the checkpointer, so that no update stays private.
+void Model::mergeHotRows() {
+  syncHotRows(*wo_, hotOut_, hotOutBase_);
+  syncHotRows(*wi_, hotIn_, hotInBase_);
+}
+
+// Binary logistic losses of targets_ against hidden_, with labels_ as the
+// expected outputs. All the scores are computed before any row is updated,
+// so that the sigmoids and the logs go through the array kernels at once.
+real Model::binaryLogistic(real lr) {
+  int32_t n = targets_.size();
+  scores_.resize(n);
+  for (int32_t i = 0; i < n; i++) {
+    int32_t target = targets_[i];
+    scores_[i] = (target < hotOut_.m_ ? hotOut_ : *wo_).dotRow(hidden_, target);
+  }
+  utils::sigmoid_n(scores_.data(), scores_.data(), n);
+  for (int32_t i = 0; i < n; i++) {
+    int32_t target = targets_[i];
+    Matrix& wo = target < hotOut_.m_ ? hotOut_ : *wo_;
+    real score = scores_[i];
+    real alpha = lr * (labels_[i] - score);
+    grad_.addRow(wo, target, alpha);
+    wo.addRow(hidden_, target, alpha);
+    scores_[i] = labels_[i] * score + (1.0 - labels_[i]) * (1.0 - score);
+  }
+  utils::log_n(scores_.data(), scores_.data(), n);
   real loss = 0.0;
+  for (int32_t i = 0; i < n; i++) {
+    loss -= scores_[i];
+  }
+  return loss;
+}
+
+real Model::negativeSampling(int32_t target, real lr) {
   grad_.zero();
+  targets_.clear();
+  labels_.clear();
   for (int32_t n = 0; n <= args_->neg; n++) {
-    if (n == 0) {
-      loss += binaryLogistic(target, true, lr);
-    } else {
-      loss += binaryLogistic(getNegative(target), false, lr);
-    }
+    targets_.push_back(n == 0 ? target : getNegative(target));
+    labels_.push_back(n == 0 ? 1.0 : 0.0);
   }
-  return loss;
+  return binaryLogistic(lr);
 }
 
 real Model::hierarchicalSoftmax(int32_t target, real lr) {
-  real loss = 0.0;
   grad_.zero();
   const std::vector<bool>& binaryCode = codes[target];
   const std::vector<int32_t>& pathToRoot = paths[target];
-  for (int32_t i = 0; i < pathToRoot.size(); i++) {
-    loss += binaryLogistic(pathToRoot[i], binaryCode[i], lr);
-  }
-  return loss;
+  targets_.assign(pathToRoot.begin(), pathToRoot.end());
+  labels_.assign(binaryCode.begin(), binaryCode.end());
+  return binaryLogistic(lr);
 }
 
 void Model::computeOutputSoftmax() {
@@ -70,7 +138,10 @@ void Model::computeOutputSoftmax() {
     max = std::max(output_[i], max);
   }
   for (int32_t i = 0; i < osz_; i++) {
-    output_[i] = exp(output_[i] - max);
+    output_[i] -= max;
+  }
+  utils::exp_n(output_.data_, output_.data_, osz_);
+  for (int32_t i = 0; i < osz_; i++) {
     z += output_[i];
   }
   for (int32_t i = 0; i < osz_; i++) {
@@ -114,13 +185,15 @@ void Model::predict(const std::vector<int32_t>& input, int32_t k, std::vector<st
   std::sort_heap(heap.begin(), heap.end(), comparePairs);
 }
 
+// Leaves the log-probabilities in output_.
 void Model::findKBest(int32_t k, std::vector<std::pair<real, int32_t>>& heap) {
   computeOutputSoftmax();
+  utils::log_n(output_.data_, output_.data_, osz_);
   for (int32_t i = 0; i < osz_; i++) {
-    if (heap.size() == k && utils::log(output_[i]) < heap.front().first) {
+    if (heap.size() == k && output_[i] < heap.front().first) {
       continue;
     }
-    heap.push_back(std::make_pair(utils::log(output_[i]), i));
+    heap.push_back(std::make_pair(output_[i], i));
     std::push_heap(heap.begin(), heap.end(), comparePairs);
     if (heap.size() > k) {
       std::pop_heap(heap.begin(), heap.end(), comparePairs);
@@ -149,30 +222,77 @@ void Model::dfs(int32_t k, int32_t node, real score, std::vector<std::pair<real,
   dfs(k, tree[node].right, score + utils::log(f), heap);
 }
 
-void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
+void Model::update(id_range input, int32_t target, real lr) {
   assert(target >= 0);
   assert(target < osz_);
   if (input.size() == 0) return;
+  if (batch_) {
+    batch_->add(input, target, lr);
+    return;
+  }
   hidden_.zero();
   for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    hidden_.addRow(*wi_, *it);
+    hidden_.addRow(*it < hotIn_.m_ ? hotIn_ : *wi_, *it);
   }
   hidden_.mul(1.0 / input.size());
 
+  real loss;
   if (args_->loss == loss_name::ns) {
-    loss_ += negativeSampling(target, lr);
+    loss = negativeSampling(target, lr);
   } else if (args_->loss == loss_name::hs) {
-    loss_ += hierarchicalSoftmax(target, lr);
+    loss = hierarchicalSoftmax(target, lr);
   } else {
-    loss_ += softmax(target, lr);
+    loss = softmax(target, lr);
   }
+  loss_ += loss;
   nexamples_ += 1;
+  if (metrics_ != nullptr) {
+    MetricsSlot::add(metrics_->examples, int64_t(1));
+    MetricsSlot::add(metrics_->loss, double(loss));
+  }
 
   if (args_->model == model_name::sup) {
     grad_.mul(1.0 / input.size());
   }
   for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    wi_->addRow(grad_, *it, 1.0);
+    (*it < hotIn_.m_ ? hotIn_ : *wi_).addRow(grad_, *it, 1.0);
+  }
+  if (hotOut_.m_ + hotIn_.m_ > 0 && ++hotSteps_ % args_->hotSync == 0) {
+    mergeHotRows();
+  }
+}
+
+// -prefetch: requests the rows an update coming `ahead` updates from now
+// will read, so that they are in cache by the time it runs. Negatives are
+// the ones at that distance in the table, which rejections may shift by a
+// few. Nothing is done for mini-batches, which gather their rows at once.
+void Model::prefetchInput(id_range input) const {
+  if (batch_) return;
+  for (auto it = input.cbegin(); it != input.cend(); ++it) {
+    (*it < hotIn_.m_ ? hotIn_ : *wi_).prefetchRow(*it);
+  }
+}
+
+void Model::prefetchOutput(int32_t target, int32_t ahead) const {
+  if (batch_) return;
+  if (args_->loss == loss_name::ns) {
+    (target < hotOut_.m_ ? hotOut_ : *wo_).prefetchRow(target);
+    for (int32_t n = 0; n < args_->neg; n++) {
+      int32_t negative = negatives[(negpos + int64_t(ahead) * args_->neg + n) % negatives.size()];
+      (negative < hotOut_.m_ ? hotOut_ : *wo_).prefetchRow(negative);
+    }
+  } else if (args_->loss == loss_name::hs) {
+    for (int32_t node : paths[target]) {
+      wo_->prefetchRow(node);
+    }
+  }
+}
+
+// Applies the pairs still queued in the mini-batch, if any. Called with
+// mergeHotRows, before the state of the model is saved.
+void Model::flush() {
+  if (batch_) {
+    batch_->flush();
   }
 }
 
@@ -181,8 +301,9 @@ void Model::setTargetCounts(const std::vector<int64_t>& counts, const std::share
   dict_ = dict;
   
   for(int32_t i = 0; i < dict_->nwords(); i++) {
-    lang_mask_.push_back(dict_->getWord(i).back());
+    lang_mask_.push_back(dict_->getLang(i));
   }
+  buffersAccount_.set((hidden_.m_ + output_.m_ + grad_.m_) * sizeof(real) + lang_mask_.capacity());
   
   if (args_->loss == loss_name::ns) {
     initTableNegatives(counts);
@@ -193,10 +314,12 @@ void Model::setTargetCounts(const std::vector<int64_t>& counts, const std::share
 }
 
 void Model::initTableNegatives(const std::vector<int64_t>& counts) {
+  profile::Phase phase("model.initTableNegatives");
   real z = 0.0;
   for (size_t i = 0; i < counts.size(); i++) {
     z += pow(counts[i], 0.5);
   }
+  negatives.reserve(NEGATIVE_TABLE_SIZE + counts.size());
   for (size_t i = 0; i < counts.size(); i++) {
     real c = pow(counts[i], 0.5);
     for (size_t j = 0; j < c * NEGATIVE_TABLE_SIZE / z; j++) {
@@ -204,20 +327,27 @@ void Model::initTableNegatives(const std::vector<int64_t>& counts) {
     }
   }
   std::shuffle(negatives.begin(), negatives.end(), rng);
+  negativesAccount_.set(negatives.capacity() * sizeof(int32_t));
 }
 
 int32_t Model::getNegative(int32_t target) {
   int32_t negative;
+  int64_t rejected = -1;
   do {
     negative = negatives[negpos];
     negpos = (negpos + 1) % negatives.size();
+    rejected++;
   } while ((target == negative) || (lang_mask_[target] != lang_mask_[negative])); // New
 //  } while ((target == negative) || (dict_->getWord(target).back() != dict_->getWord(negative).back())); // Old and slower
   
+  if (metrics_ != nullptr && rejected > 0) {
+    MetricsSlot::add(metrics_->negativesRejected, rejected);
+  }
   return negative;
 }
 
 void Model::buildTree(const std::vector<int64_t>& counts) {
+  profile::Phase phase("model.buildTree");
   tree.resize(2 * osz_ - 1);
   for (int32_t i = 0; i < 2 * osz_ - 1; i++) {
     tree[i].parent = -1;
@@ -259,8 +389,69 @@ void Model::buildTree(const std::vector<int64_t>& counts) {
     paths.push_back(path);
     codes.push_back(code);
   }
+  int64_t bytes = tree.capacity() * sizeof(Node);
+  for (int32_t i = 0; i < osz_; i++) {
+    bytes += sizeof(paths[i]) + paths[i].capacity() * sizeof(int32_t);
+    bytes += sizeof(codes[i]) + codes[i].capacity() / 8;
+  }
+  treeAccount_.set(bytes);
 }
 
 real Model::getLoss() {
   return loss_ / nexamples_;
 }
+
+// Upper bound of the bytes a Model with `osz` outputs will allocate.
+int64_t Model::estimateMemory(std::shared_ptr<Args> args, int64_t osz, int64_t nwords) {
+  int64_t bytes = (2 * args->dim + osz) * sizeof(real) + nwords;
+  if (args->hotRows > 0 && args->loss == loss_name::ns) {
+    bytes += 2 * std::min(int64_t(args->hotRows), osz) * alloc::rowStride(args->dim) * sizeof(real);
+  }
+  if (args->hotRows > 0 && args->hotInput) {
+    bytes += 2 * std::min(int64_t(args->hotRows), nwords) * alloc::rowStride(args->dim) * sizeof(real);
+  }
+  if (args->loss == loss_name::ns) {
+    bytes += (NEGATIVE_TABLE_SIZE + osz) * sizeof(int32_t);
+  }
+  if (args->batch > 0) {
+    bytes += MiniBatch::estimateMemory(args, osz);
+  }
+  if (args->loss == loss_name::hs) {
+    int64_t depth = 1;
+    while ((int64_t(1) << depth) < osz) depth++;
+    bytes += (2 * osz - 1) * sizeof(Node);
+    bytes += osz * (sizeof(std::vector<int32_t>) + sizeof(std::vector<bool>) + depth * sizeof(int32_t) + depth / 8 + 8);
+  }
+  return bytes;
+}
+
+void Model::saveState(std::ostream& out) {
+  std::ostringstream state;
+  state << rng;
+  std::string s = state.str();
+  int64_t size = s.size();
+  uint64_t pos = negpos;
+  out.write((char*) &size, sizeof(int64_t));
+  out.write(s.data(), size);
+  out.write((char*) &pos, sizeof(uint64_t));
+  out.write((char*) &loss_, sizeof(real));
+  out.write((char*) &nexamples_, sizeof(int64_t));
+}
+
+void Model::loadState(std::istream& in) {
+  int64_t size;
+  uint64_t pos;
+  in.read((char*) &size, sizeof(int64_t));
+  std::string s(size, '\0');
+  in.read(&s[0], size);
+  std::istringstream state(s);
+  state >> rng;
+  in.read((char*) &pos, sizeof(uint64_t));
+  in.read((char*) &loss_, sizeof(real));
+  in.read((char*) &nexamples_, sizeof(int64_t));
+  negpos = negatives.empty() ? 0 : pos % negatives.size();
+}
+
+void Model::setMetrics(MetricsSlot* metrics) {
+  metrics_ = metrics;
+}
@@ -19,6 +19,9 @@
 #include "matrix.h"
 #include "vector.h"
 #include "dictionary.h"
+#include "metrics.h"
+#include "minibatch.h"
+#include "profile.h"
 #include "real.h"
 
 struct Node {
@@ -38,6 +41,9 @@ class Model {
     Vector hidden_;
     Vector output_;
     Vector grad_;
+    std::vector<int32_t> targets_;
+    std::vector<real> labels_;
+    std::vector<real> scores_;
     int32_t hsz_;
     int32_t isz_;
     int32_t osz_;
@@ -55,11 +61,28 @@ class Model {
     static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
     
     std::shared_ptr<Dictionary> dict_;
+    MetricsSlot* metrics_;
+
+    profile::Account negativesAccount_;
+    profile::Account treeAccount_;
+    profile::Account buffersAccount_;
+
+    Matrix hotOut_;
+    Matrix hotOutBase_;
+    Matrix hotIn_;
+    Matrix hotInBase_;
+    int64_t hotSteps_;
+
+    void initHotRows(const Matrix&, Matrix&, Matrix&);
+    static void syncHotRows(Matrix&, Matrix&, Matrix&);
+
+    std::unique_ptr<MiniBatch> batch_;
+    friend class MiniBatch;
     
   public:
     Model(std::shared_ptr<Matrix>, std::shared_ptr<Matrix>, std::shared_ptr<Args>, int32_t);
     
-    real binaryLogistic(int32_t, bool, real);
+    real binaryLogistic(real);
     real negativeSampling(int32_t, real);
     real hierarchicalSoftmax(int32_t, real);
     real softmax(int32_t, real);
@@ -67,7 +90,10 @@ class Model {
     void predict(const std::vector<int32_t>&, int32_t, std::vector<std::pair<real, int32_t>>&);
     void dfs(int32_t, int32_t, real, std::vector<std::pair<real, int32_t>>&);
     void findKBest(int32_t, std::vector<std::pair<real, int32_t>>&);
-    void update(const std::vector<int32_t>&, int32_t, real);
+    void update(id_range, int32_t, real);
+    void prefetchInput(id_range) const;
+    void prefetchOutput(int32_t, int32_t) const;
+    void flush();
     void computeHidden(const std::vector<int32_t>&);
     void computeOutputSoftmax();
 
@@ -76,6 +102,11 @@ class Model {
     int32_t getNegative(int32_t target);
     void buildTree(const std::vector<int64_t>&);
     real getLoss();
+    void saveState(std::ostream&);
+    void loadState(std::istream&);
+    static int64_t estimateMemory(std::shared_ptr<Args>, int64_t, int64_t);
+    void setMetrics(MetricsSlot*);
+    void mergeHotRows();
     
     bool compareLang(int32_t, int32_t, bool);
     
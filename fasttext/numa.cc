@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "numa.h"
+
+#include <sched.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "profile.h"
+
+namespace numa {
+
+  // Parses a sysfs cpulist such as "0-3,8-11".
+  std::vector<int32_t> parseCpuList(const std::string& list) {
+    std::vector<int32_t> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      if (range.empty()) continue;
+      size_t dash = range.find('-');
+      int32_t first = std::stoi(range.substr(0, dash));
+      int32_t last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int32_t cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  std::vector<std::vector<int32_t>> nodes() {
+    std::vector<std::vector<int32_t>> result;
+    for (int32_t node = 0; ; node++) {
+      std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!in.is_open()) break;
+      std::string list;
+      std::getline(in, list);
+      std::vector<int32_t> cpus = parseCpuList(list);
+      if (!cpus.empty()) result.push_back(cpus);
+    }
+    if (result.empty()) {
+      std::vector<int32_t> cpus;
+      for (int32_t cpu = 0; cpu < int32_t(std::thread::hardware_concurrency()); cpu++) {
+        cpus.push_back(cpu);
+      }
+      result.push_back(cpus);
+    }
+    return result;
+  }
+
+  // CPUs the calling thread may run on, to restore after bindToCpus.
+  std::vector<int32_t> boundCpus() {
+    std::vector<int32_t> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  void bindToCpus(const std::vector<int32_t>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int32_t cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      std::cerr << "Warning: could not bind thread to its NUMA node: " << strerror(errno) << std::endl;
+    }
+  }
+
+  // Never more replicas than threads to train them.
+  int32_t replicaCount(std::shared_ptr<Args> args) {
+    int32_t n = 1;
+    if (args->replicas > 0) {
+      n = args->replicas;
+    } else if (args->numa) {
+      n = nodes().size();
+    }
+    return std::max(1, std::min(n, args->thread));
+  }
+}
+
+Replicas::Replicas(std::shared_ptr<Args> args, std::shared_ptr<Metrics> metrics,
+                   std::shared_ptr<Matrix> input, std::shared_ptr<Matrix> output) {
+  args_ = args;
+  metrics_ = metrics;
+  running_ = false;
+  syncs_ = 0;
+  nodes_ = numa::nodes();
+  int32_t n = numa::replicaCount(args);
+  inputs_.assign(n, nullptr);
+  outputs_.assign(n, nullptr);
+  inputs_[0] = input;
+  outputs_[0] = output;
+
+  profile::Phase phase("replicas.init");
+  std::vector<std::thread> threads;
+  for (int32_t r = 1; r < n; r++) {
+    threads.push_back(std::thread([this, r]() {
+      if (args_->numa) {
+        numa::bindToCpus(nodes_[r % nodes_.size()]);
+      }
+      // Matrix(m, n) leaves the pages untouched; this copy is the first
+      // touch and places them on the node of this thread.
+      inputs_[r] = std::make_shared<Matrix>(inputs_[0]->m_, inputs_[0]->n_);
+      outputs_[r] = std::make_shared<Matrix>(outputs_[0]->m_, outputs_[0]->n_);
+      inputs_[r]->account_.rename("replicas.input");
+      outputs_[r]->account_.rename("replicas.output");
+      memcpy(inputs_[r]->data_, inputs_[0]->data_, inputs_[0]->m_ * inputs_[0]->stride_ * sizeof(real));
+      memcpy(outputs_[r]->data_, outputs_[0]->data_, outputs_[0]->m_ * outputs_[0]->stride_ * sizeof(real));
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (n > 1) {
+    std::cerr << "Training " << n << " replicas over " << nodes_.size() << " NUMA node(s)" << std::endl;
+  }
+}
+
+Replicas::~Replicas() {
+  stop();
+}
+
+int32_t Replicas::size() const {
+  return inputs_.size();
+}
+
+int32_t Replicas::replicaOf(int32_t threadId) const {
+  return threadId % inputs_.size();
+}
+
+void Replicas::bindThread(int32_t threadId) const {
+  if (args_->numa) {
+    numa::bindToCpus(nodes_[replicaOf(threadId) % nodes_.size()]);
+  }
+}
+
+std::shared_ptr<Matrix> Replicas::input(int32_t threadId) const {
+  return inputs_[replicaOf(threadId)];
+}
+
+std::shared_ptr<Matrix> Replicas::output(int32_t threadId) const {
+  return outputs_[replicaOf(threadId)];
+}
+
+void Replicas::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (size() < 2 || running_) return;
+  running_ = true;
+  averager_ = std::thread([this]() { run(); });
+}
+
+// Stops the averager and leaves every replica (in particular replica 0,
+// which gets saved) at the final average.
+void Replicas::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  averager_.join();
+  average(inputs_);
+  average(outputs_);
+  if (args_->verbose > 2) {
+    std::cerr << "Averaged replicas " << syncs_ << " times" << std::endl;
+  }
+}
+
+void Replicas::run() {
+  int64_t next = args_->replicaSync;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, std::chrono::milliseconds(10), [this]() { return !running_; });
+      if (!running_) return;
+    }
+    if (metrics_->tokens() < next) continue;
+    next = metrics_->tokens() + args_->replicaSync;
+    average(inputs_);
+    average(outputs_);
+  }
+}
+
+// Element-wise mean written back to every replica, racing with the
+// trainers like any other Hogwild update. The rows are split across one
+// thread per replica, bound to the node of that replica (-numa), so that
+// the sweep uses the memory bandwidth of every node instead of one
+// thread's. Averages are rare enough that the threads are started per call.
+void Replicas::average(std::vector<std::shared_ptr<Matrix>>& replicas) {
+  profile::Phase phase("replicas.average");
+  const int32_t n = replicas.size();
+  const int64_t rows = replicas[0]->m_;
+  const int64_t stride = replicas[0]->stride_;
+  const real scale = 1.0 / n;
+  auto sweep = [&](int32_t part) {
+    if (args_->numa) {
+      numa::bindToCpus(nodes_[part % nodes_.size()]);
+    }
+    const int64_t begin = rows * part / n * stride;
+    const int64_t end = rows * (part + 1) / n * stride;
+    for (int64_t i = begin; i < end; i++) {
+      real sum = 0.0;
+      for (auto& m : replicas) {
+        sum += m->data_[i];
+      }
+      sum *= scale;
+      for (auto& m : replicas) {
+        m->data_[i] = sum;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int32_t part = 0; part < n; part++) {
+    threads.push_back(std::thread(sweep, part));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  syncs_++;
+}
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_NUMA_H
+#define FASTTEXT_NUMA_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "args.h"
+#include "matrix.h"
+#include "metrics.h"
+
+namespace numa {
+
+  // CPUs of every NUMA node, from /sys/devices/system/node. A host without
+  // that directory is one node holding every online CPU.
+  std::vector<std::vector<int32_t>> nodes();
+  std::vector<int32_t> boundCpus();
+  void bindToCpus(const std::vector<int32_t>&);
+  int32_t replicaCount(std::shared_ptr<Args>);
+}
+
+// One copy of the shared input and output matrices per replica (-numa: per
+// NUMA node). Threads train their replica Hogwild-style and a background
+// thread averages all replicas every -replicaSync trained tokens, splitting
+// the rows across one helper thread per replica, bound to its node. Replica 0
+// is the pair of matrices the run was set up with; the others are allocated
+// and first touched by a thread bound to their node.
+class Replicas {
+  private:
+    std::shared_ptr<Args> args_;
+    std::shared_ptr<Metrics> metrics_;
+    std::vector<std::vector<int32_t>> nodes_;
+    std::vector<std::shared_ptr<Matrix>> inputs_;
+    std::vector<std::shared_ptr<Matrix>> outputs_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread averager_;
+    bool running_;
+    int64_t syncs_;
+
+    void run();
+    void average(std::vector<std::shared_ptr<Matrix>>&);
+
+  public:
+    Replicas(std::shared_ptr<Args>, std::shared_ptr<Metrics>,
+             std::shared_ptr<Matrix>, std::shared_ptr<Matrix>);
+    ~Replicas();
+
+    int32_t size() const;
+    int32_t replicaOf(int32_t) const;
+    void bindThread(int32_t) const;
+    std::shared_ptr<Matrix> input(int32_t) const;
+    std::shared_ptr<Matrix> output(int32_t) const;
+
+    void start();
+    void stop();
+};
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+ExampleReader::ExampleReader(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict,
+                             int32_t threadId, std::shared_ptr<CorpusCache> cache) {
+  args_ = args;
+  dict_ = dict;
+  nshards_ = 1;
+  std::vector<std::string> possible_inputs = {args->input, args->input_mono1, args->input_mono2, args->input_par1, args->input_par2};
+  for(auto possible_input : possible_inputs) {
+    if(!possible_input.empty()) {
+      if (cache) {
+        corpora_.push_back(cache->get(possible_input));
+        cursors_.push_back(Corpus::Cursor{0, 0});
+      } else {
+        ifs_.emplace_back(new InputStream(possible_input));
+      }
+      skip(std::max(ifs_.size(), corpora_.size()) - 1, threadId * args_->threadOffset);
+    }
+  }
+}
+
+void ExampleReader::skip(size_t stream, int32_t n) {
+  if (corpora_.empty()) {
+    skipLines(*ifs_[stream], n);
+  } else {
+    corpora_[stream]->skipLines(cursors_[stream], n);
+  }
+}
+
+int32_t ExampleReader::getLine(size_t stream, std::vector<int32_t>& words,
+                               std::vector<int32_t>& labels, real u) {
+  if (corpora_.empty()) {
+    return dict_->getLine(*ifs_[stream], words, labels, args_->model, u);
+  }
+  return corpora_[stream]->getLine(cursors_[stream], *dict_, words, labels, args_->model, u);
+}
+
+void ExampleReader::skipLines(std::istream& stream, int32_t n) {
+  for (int32_t i = 0; i < n; i++) {
+    if (stream.eof()) {
+      stream.clear();
+      stream.seekg(std::streampos(0));
+    }
+    stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+}
+
+// Reads every `nshards`-th line only, starting at line `shard`. Parallel
+// streams skip the same lines, so they stay aligned.
+void ExampleReader::setShard(int32_t shard, int32_t nshards) {
+  nshards_ = nshards;
+  for (size_t i = 0; i < std::max(ifs_.size(), corpora_.size()); i++) {
+    skip(i, shard);
+  }
+}
+
+// `u` is the subsampling draw shared by the whole line.
+void ExampleReader::read(Example& example, real u) {
+  example.ntokens = getLine(0, example.line1, example.labels, u);
+  if (args_->model == model_name::sup) {
+    dict_->addNgrams(example.line1, args_->wordNgrams);
+  } else if (args_->model == model_name::bil) {
+    std::vector<int32_t> labels;
+    getLine(1, example.line2, labels, u);
+  }
+  if (nshards_ > 1) {
+    skip(0, nshards_ - 1);
+    if (args_->model == model_name::bil) {
+      skip(1, nshards_ - 1);
+    }
+  }
+}
+
+std::vector<int64_t> ExampleReader::positions() {
+  std::vector<int64_t> pos;
+  for (auto& stream : ifs_) {
+    pos.push_back(stream->eof() ? 0 : int64_t(stream->tellg()));
+  }
+  for (auto& cursor : cursors_) {
+    pos.push_back(cursor.line);
+  }
+  return pos;
+}
+
+void ExampleReader::seek(const std::vector<int64_t>& pos) {
+  for (size_t i = 0; i < pos.size() && i < ifs_.size(); i++) {
+    ifs_[i]->clear();
+    ifs_[i]->seekg(std::streampos(std::max(pos[i], int64_t(0))));
+  }
+  for (size_t i = 0; i < pos.size() && i < corpora_.size(); i++) {
+    cursors_[i] = Corpus::Cursor{0, 0};
+    corpora_[i]->skipLines(cursors_[i], std::max(pos[i], int64_t(0)));
+  }
+}
+
+void ExampleReader::close() {
+  for (auto& stream : ifs_) {
+    stream->close();
+  }
+  corpora_.clear();
+  cursors_.clear();
+}
+
+Channel::Channel(std::shared_ptr<ExampleReader> r, int32_t nbatches, int32_t seed)
+  : reader(r), full(nbatches), free(nbatches), rng(seed) {
+  for (int32_t i = 0; i < nbatches; i++) {
+    batches.emplace_back(new Batch());
+    batches.back()->size = 0;
+    free.push(batches.back().get());
+  }
+}
+
+Pipeline::Pipeline(std::shared_ptr<Args> args) {
+  args_ = args;
+}
+
+Pipeline::~Pipeline() {
+  stop();
+}
+
+bool Pipeline::enabled() const {
+  return args_->readers > 0;
+}
+
+std::shared_ptr<Channel> Pipeline::add(std::shared_ptr<ExampleReader> reader) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<Channel> channel = std::make_shared<Channel>(reader, 8, channels_.size() + 1);
+  channels_.push_back(channel);
+  generation_++;
+  return channel;
+}
+
+void Pipeline::start() {
+  if (!enabled() || running_) return;
+  running_ = true;
+  for (int32_t i = 0; i < args_->readers; i++) {
+    threads_.push_back(std::thread([this, i]() { run(i); }));
+  }
+}
+
+void Pipeline::stop() {
+  if (!running_) return;
+  running_ = false;
+  for (auto& t : threads_) {
+    t.join();
+  }
+  threads_.clear();
+}
+
+// Channels are added while the readers run (the umt trainers build theirs
+// in their own threads), so each reader refreshes its share whenever the
+// generation moves. A closed channel belongs to a task that finished and
+// is skipped; its trainer may be gone, but the channel and its streams
+// live on until the pipeline drops them.
+void Pipeline::run(int32_t id) {
+  std::vector<std::shared_ptr<Channel>> mine;
+  int64_t seen = -1;
+  while (running_) {
+    if (generation_ != seen) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      seen = generation_;
+      mine.clear();
+      for (size_t i = id; i < channels_.size(); i += args_->readers) {
+        mine.push_back(channels_[i]);
+      }
+    }
+    bool busy = false;
+    for (auto& channel : mine) {
+      if (channel->closed) continue;
+      Batch* batch;
+      if (!channel->free.pop(batch)) continue;
+      fill(*channel, batch);
+      channel->full.push(batch);
+      busy = true;
+    }
+    if (!busy) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+}
+
+void Pipeline::fill(Channel& channel, Batch* batch) {
+  std::uniform_real_distribution<> uniform(0, 1);
+  batch->positions = channel.reader->positions();
+  batch->examples.resize(args_->readBatch);
+  for (auto& example : batch->examples) {
+    channel.reader->read(example, uniform(channel.rng));
+  }
+  batch->size = batch->examples.size();
+}
@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_PIPELINE_H
+#define FASTTEXT_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "args.h"
+#include "corpus.h"
+#include "dictionary.h"
+#include "input.h"
+#include "real.h"
+
+// One training example: the subsampled ids of a line (and of its parallel
+// line for bilingual tasks), its labels and the number of tokens read.
+struct Example {
+  std::vector<int32_t> line1;
+  std::vector<int32_t> line2;
+  std::vector<int32_t> labels;
+  int32_t ntokens;
+};
+
+// The input streams of one task and how they are cut into examples:
+// thread offset, sharding, subsampling and word n-grams. Given a
+// CorpusCache, the streams are replayed from its corpora instead of being
+// parsed; positions are then line numbers.
+class ExampleReader {
+  private:
+    std::shared_ptr<Args> args_;
+    std::shared_ptr<Dictionary> dict_;
+    std::vector<std::unique_ptr<InputStream>> ifs_;
+    std::vector<std::shared_ptr<Corpus>> corpora_;
+    std::vector<Corpus::Cursor> cursors_;
+    int32_t nshards_;
+
+    void skipLines(std::istream&, int32_t);
+    void skip(size_t, int32_t);
+    int32_t getLine(size_t, std::vector<int32_t>&, std::vector<int32_t>&, real);
+
+  public:
+    ExampleReader(std::shared_ptr<Args>, std::shared_ptr<Dictionary>, int32_t,
+                  std::shared_ptr<CorpusCache> = nullptr);
+
+    void setShard(int32_t, int32_t);
+    void read(Example&, real);
+    std::vector<int64_t> positions();
+    void seek(const std::vector<int64_t>&);
+    void close();
+};
+
+// Fixed-capacity single-producer single-consumer queue. push() is only
+// called by the producer and pop() only by the consumer; each side owns one
+// index and reads the other with acquire ordering.
+template<typename T>
+class SpscRing {
+  private:
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+
+  public:
+    explicit SpscRing(size_t capacity) : slots_(capacity + 1) {}
+
+    bool push(const T& x) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      size_t next = (tail + 1) % slots_.size();
+      if (next == head_.load(std::memory_order_acquire)) return false;
+      slots_[tail] = x;
+      tail_.store(next, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T& x) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire)) return false;
+      x = slots_[head];
+      head_.store((head + 1) % slots_.size(), std::memory_order_release);
+      return true;
+    }
+};
+
+struct Batch {
+  std::vector<Example> examples;
+  int32_t size;
+  std::vector<int64_t> positions;
+};
+
+// The examples of one task, parsed ahead by a reader thread. Batches cycle
+// between the two rings, so neither side allocates once they are warm.
+struct Channel {
+  std::shared_ptr<ExampleReader> reader;
+  std::vector<std::unique_ptr<Batch>> batches;
+  SpscRing<Batch*> full;
+  SpscRing<Batch*> free;
+  std::minstd_rand rng;
+  std::atomic<bool> closed{false};
+
+  Channel(std::shared_ptr<ExampleReader>, int32_t, int32_t);
+};
+
+// -readers threads that fill the channels of all training tasks; channel i
+// is served by reader i % readers.
+class Pipeline {
+  private:
+    std::shared_ptr<Args> args_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Channel>> channels_;
+    std::atomic<int64_t> generation_{0};
+    std::vector<std::thread> threads_;
+    std::atomic<bool> running_{false};
+
+    void run(int32_t);
+    void fill(Channel&, Batch*);
+
+  public:
+    explicit Pipeline(std::shared_ptr<Args>);
+    ~Pipeline();
+
+    bool enabled() const;
+    std::shared_ptr<Channel> add(std::shared_ptr<ExampleReader>);
+    void start();
+    void stop();
+};
+
+#endif
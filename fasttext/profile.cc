@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "profile.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "alloc.h"
+
+namespace profile {
+
+  struct PhaseStat {
+    int64_t calls;
+    double seconds;
+  };
+
+  struct LedgerEntry {
+    int64_t holders;
+    int64_t current;
+    int64_t peak;
+  };
+
+  // Leaked on purpose: accounts held by static objects may be released
+  // after these would have been destroyed.
+  std::mutex& lock() {
+    static std::mutex* m = new std::mutex();
+    return *m;
+  }
+
+  std::vector<std::string>& phaseOrder() {
+    static std::vector<std::string>* v = new std::vector<std::string>();
+    return *v;
+  }
+
+  std::map<std::string, PhaseStat>& phases() {
+    static std::map<std::string, PhaseStat>* m = new std::map<std::string, PhaseStat>();
+    return *m;
+  }
+
+  std::map<std::string, LedgerEntry>& ledger() {
+    static std::map<std::string, LedgerEntry>* m = new std::map<std::string, LedgerEntry>();
+    return *m;
+  }
+
+  int64_t g_current = 0;
+  int64_t g_peak = 0;
+
+  void adjust(const std::string& category, int64_t delta, int64_t holders) {
+    std::lock_guard<std::mutex> guard(lock());
+    LedgerEntry& e = ledger()[category];
+    e.holders += holders;
+    e.current += delta;
+    e.peak = std::max(e.peak, e.current);
+    g_current += delta;
+    g_peak = std::max(g_peak, g_current);
+  }
+
+  Phase::Phase(const std::string& name) : name_(name) {
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  Phase::~Phase() {
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    std::lock_guard<std::mutex> guard(lock());
+    auto it = phases().find(name_);
+    if (it == phases().end()) {
+      phaseOrder().push_back(name_);
+      phases()[name_] = PhaseStat{1, s};
+    } else {
+      it->second.calls++;
+      it->second.seconds += s;
+    }
+  }
+
+  Account::Account(const std::string& category) : category_(category), bytes_(0) {
+    adjust(category_, 0, 1);
+  }
+
+  Account::Account(const Account& other) : category_(other.category_), bytes_(other.bytes_) {
+    adjust(category_, bytes_, 1);
+  }
+
+  Account& Account::operator=(const Account& other) {
+    if (this != &other) {
+      rename(other.category_);
+      set(other.bytes_);
+    }
+    return *this;
+  }
+
+  Account::~Account() {
+    adjust(category_, -bytes_, -1);
+  }
+
+  void Account::set(int64_t bytes) {
+    adjust(category_, bytes - bytes_, 0);
+    bytes_ = bytes;
+  }
+
+  void Account::rename(const std::string& category) {
+    if (category == category_) return;
+    adjust(category_, -bytes_, -1);
+    category_ = category;
+    adjust(category_, bytes_, 1);
+  }
+
+  int64_t Account::bytes() const {
+    return bytes_;
+  }
+
+  int64_t currentBytes() {
+    std::lock_guard<std::mutex> guard(lock());
+    return g_current;
+  }
+
+  void checkBudget(int64_t budget, const std::vector<Estimate>& planned) {
+    if (budget <= 0) return;
+    int64_t held = currentBytes();
+    int64_t total = held;
+    for (auto& e : planned) total += e.bytes;
+    if (total <= budget) return;
+    std::cerr << std::fixed << std::setprecision(1);
+    std::cerr << "Memory budget of " << budget / 1048576.0 << "MB exceeded: "
+              << total / 1048576.0 << "MB needed" << std::endl;
+    std::cerr << "  " << std::left << std::setw(28) << "already held"
+              << std::right << std::setw(10) << held / 1048576.0 << "MB" << std::endl;
+    for (auto& e : planned) {
+      std::cerr << "  " << std::left << std::setw(28) << e.category
+                << std::right << std::setw(10) << e.bytes / 1048576.0 << "MB" << std::endl;
+    }
+    exit(EXIT_FAILURE);
+  }
+
+  void printSummary(std::ostream& out) {
+    std::lock_guard<std::mutex> guard(lock());
+    out << std::fixed;
+    out << "--\n" << std::left << std::setw(28) << "Phase"
+        << std::right << std::setw(8) << "calls" << std::setw(12) << "seconds" << "\n";
+    for (auto& name : phaseOrder()) {
+      const PhaseStat& p = phases()[name];
+      out << std::left << std::setw(28) << name << std::right << std::setw(8) << p.calls
+          << std::setw(12) << std::setprecision(3) << p.seconds << "\n";
+    }
+    out << "--\n" << std::left << std::setw(28) << "Memory"
+        << std::right << std::setw(8) << "holders" << std::setw(12) << "current MB"
+        << std::setw(12) << "peak MB" << "\n";
+    for (auto& it : ledger()) {
+      if (it.second.peak == 0) continue;
+      out << std::left << std::setw(28) << it.first << std::right
+          << std::setw(8) << it.second.holders << std::setprecision(1)
+          << std::setw(12) << it.second.current / 1048576.0
+          << std::setw(12) << it.second.peak / 1048576.0 << "\n";
+    }
+    out << std::left << std::setw(28) << "total" << std::right << std::setw(8) << ""
+        << std::setw(12) << g_current / 1048576.0
+        << std::setw(12) << g_peak / 1048576.0 << std::endl;
+    alloc::HugePages huge = alloc::hugePages();
+    if (huge.requested > 0) {
+      out << std::left << std::setw(28) << "huge pages" << std::right << std::setw(8) << ""
+          << std::setw(12) << huge.backed / 1048576.0 << " of " << huge.requested / 1048576.0
+          << "MB (" << 100.0 * huge.backed / huge.requested << "%)" << std::endl;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_PROFILE_H
+#define FASTTEXT_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace profile {
+
+  // Times the enclosing scope and adds it to the named phase. Phases may be
+  // entered concurrently; their totals are then summed over threads.
+  class Phase {
+    private:
+      std::string name_;
+      std::chrono::steady_clock::time_point start_;
+
+    public:
+      explicit Phase(const std::string&);
+      ~Phase();
+  };
+
+  // Bytes held by one object under a ledger category. The holder calls set()
+  // whenever its footprint changes; the bytes are released on destruction.
+  class Account {
+    private:
+      std::string category_;
+      int64_t bytes_;
+
+    public:
+      explicit Account(const std::string&);
+      Account(const Account&);
+      Account& operator=(const Account&);
+      ~Account();
+
+      void set(int64_t);
+      void rename(const std::string&);
+      int64_t bytes() const;
+  };
+
+  struct Estimate {
+    std::string category;
+    int64_t bytes;
+  };
+
+  int64_t currentBytes();
+  void checkBudget(int64_t, const std::vector<Estimate>&);
+  void printSummary(std::ostream&);
+}
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "sketch.h"
+
+#include <algorithm>
+#include <limits>
+
+CountMinSketch::CountMinSketch(int64_t bytes) : account_("dictionary.sketch") {
+  width_ = std::max(int64_t(1), int64_t(bytes / (DEPTH * sizeof(uint32_t))));
+  counters_.assign(DEPTH * width_, 0);
+  account_.set(counters_.capacity() * sizeof(uint32_t));
+}
+
+// One counter per row, from the two halves of a 64-bit FNV-1a hash
+// (double hashing). The dictionary's own 32-bit hash would make words that
+// collide there collide in every row.
+void CountMinSketch::slots(const std::string& word, int64_t* slot) const {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < word.size(); i++) {
+    h = h ^ uint64_t(uint8_t(word[i]));
+    h = h * 1099511628211ULL;
+  }
+  uint64_t h1 = h & 0xffffffff, h2 = (h >> 32) | 1;
+  for (int32_t d = 0; d < DEPTH; d++) {
+    slot[d] = d * width_ + int64_t((h1 + d * h2) % width_);
+  }
+}
+
+// Raises only the counters that hold the current minimum, and returns the
+// new estimate.
+uint32_t CountMinSketch::add(const std::string& word) {
+  int64_t slot[DEPTH];
+  slots(word, slot);
+  uint32_t m = std::numeric_limits<uint32_t>::max();
+  for (int32_t d = 0; d < DEPTH; d++) {
+    m = std::min(m, counters_[slot[d]]);
+  }
+  if (m == std::numeric_limits<uint32_t>::max()) return m;
+  for (int32_t d = 0; d < DEPTH; d++) {
+    if (counters_[slot[d]] == m) counters_[slot[d]] = m + 1;
+  }
+  return m + 1;
+}
+
+uint32_t CountMinSketch::estimate(const std::string& word) const {
+  int64_t slot[DEPTH];
+  slots(word, slot);
+  uint32_t m = std::numeric_limits<uint32_t>::max();
+  for (int32_t d = 0; d < DEPTH; d++) {
+    m = std::min(m, counters_[slot[d]]);
+  }
+  return m;
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_SKETCH_H
+#define FASTTEXT_SKETCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "profile.h"
+
+// Count-min sketch over words with conservative update: a fixed number of
+// counters, estimates that are never below the true count and overshoot
+// it only through collisions.
+class CountMinSketch {
+  private:
+    static const int32_t DEPTH = 4;
+
+    int64_t width_;
+    std::vector<uint32_t> counters_;
+    profile::Account account_;
+
+    void slots(const std::string&, int64_t*) const;
+
+  public:
+    explicit CountMinSketch(int64_t);
+
+    uint32_t add(const std::string&);
+    uint32_t estimate(const std::string&) const;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "sweep.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+bool Sweep::sweepable(const std::string& name) {
+  return name == "lr" || name == "lr_mono" || name == "lr_par" ||
+         name == "dim" || name == "ws" || name == "neg";
+}
+
+static bool isRate(const std::string& name) {
+  return name.compare(0, 2, "lr") == 0;
+}
+
+static double parseValue(const std::string& name, const std::string& text) {
+  char* end;
+  double v = strtod(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || v <= 0) {
+    std::cerr << "Invalid value for -" << name << ": " << text << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return v;
+}
+
+Sweep::Sweep(std::vector<std::string>& argv) : trials_(0) {
+  size_t ai = 2;
+  while (ai + 1 < argv.size()) {
+    std::string name = argv[ai].substr(1);
+    const std::string& value = argv[ai + 1];
+    if (name == "trials") {
+      trials_ = atoi(value.c_str());
+      if (trials_ < 1) {
+        std::cerr << "-trials must be at least 1." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    } else if (sweepable(name) && value.find_first_of(",:") != std::string::npos) {
+      Axis axis{name, {}, 0, 0, false};
+      size_t colon = value.find(':');
+      if (colon != std::string::npos) {
+        axis.range = true;
+        axis.lo = parseValue(name, value.substr(0, colon));
+        axis.hi = parseValue(name, value.substr(colon + 1));
+        if (axis.lo > axis.hi) {
+          std::cerr << "Empty range for -" << name << ": " << value << std::endl;
+          exit(EXIT_FAILURE);
+        }
+      } else {
+        std::istringstream in(value);
+        std::string item;
+        while (std::getline(in, item, ',')) {
+          axis.values.push_back(parseValue(name, item));
+        }
+      }
+      axes_.push_back(axis);
+    } else {
+      ai += 2;
+      continue;
+    }
+    argv.erase(argv.begin() + ai, argv.begin() + ai + 2);
+  }
+}
+
+std::vector<std::vector<double>> Sweep::trials() const {
+  std::vector<std::vector<double>> result;
+  if (trials_ == 0) {
+    for (auto& axis : axes_) {
+      if (axis.range) {
+        std::cerr << "-" << axis.name << " is a range: set the number of random -trials." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    // Odometer over the lists, the last axis turning fastest.
+    std::vector<size_t> index(axes_.size(), 0);
+    while (true) {
+      std::vector<double> values;
+      for (size_t a = 0; a < axes_.size(); a++) {
+        values.push_back(axes_[a].values[index[a]]);
+      }
+      result.push_back(values);
+      int64_t a = int64_t(axes_.size()) - 1;
+      while (a >= 0 && ++index[a] == axes_[a].values.size()) {
+        index[a--] = 0;
+      }
+      if (a < 0) break;
+    }
+    return result;
+  }
+  std::minstd_rand rng(1);
+  for (int32_t t = 0; t < trials_; t++) {
+    std::vector<double> values;
+    for (auto& axis : axes_) {
+      if (!axis.range) {
+        std::uniform_int_distribution<size_t> pick(0, axis.values.size() - 1);
+        values.push_back(axis.values[pick(rng)]);
+      } else if (isRate(axis.name)) {
+        std::uniform_real_distribution<> uniform(log(axis.lo), log(axis.hi));
+        values.push_back(exp(uniform(rng)));
+      } else {
+        std::uniform_int_distribution<int32_t> uniform(lround(axis.lo), lround(axis.hi));
+        values.push_back(uniform(rng));
+      }
+    }
+    result.push_back(values);
+  }
+  return result;
+}
+
+void Sweep::apply(const std::vector<double>& values, Args& args) const {
+  for (size_t a = 0; a < axes_.size(); a++) {
+    const std::string& name = axes_[a].name;
+    if (name == "lr") {
+      args.lr = values[a];
+    } else if (name == "lr_mono") {
+      args.lr_mono = values[a];
+    } else if (name == "lr_par") {
+      args.lr_par = values[a];
+    } else if (name == "dim") {
+      args.dim = lround(values[a]);
+    } else if (name == "ws") {
+      args.ws = lround(values[a]);
+    } else if (name == "neg") {
+      args.neg = lround(values[a]);
+    }
+  }
+}
+
+// Best trial first.
+void Sweep::printTable(std::ostream& out, std::vector<Result> results) const {
+  std::stable_sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+    return a.precision > b.precision;
+  });
+  out << std::left << std::setw(8) << "trial" << std::right;
+  for (auto& axis : axes_) {
+    out << std::setw(10) << axis.name;
+  }
+  out << std::setw(10) << "P@1" << std::setw(10) << "loss" << std::setw(10) << "seconds" << "\n";
+  for (auto& r : results) {
+    out << std::left << std::setw(8) << r.trial << std::right;
+    for (size_t a = 0; a < axes_.size(); a++) {
+      if (isRate(axes_[a].name)) {
+        out << std::setw(10) << std::setprecision(4) << std::defaultfloat << r.values[a];
+      } else {
+        out << std::setw(10) << lround(r.values[a]);
+      }
+    }
+    out << std::fixed << std::setprecision(3)
+        << std::setw(10) << r.precision << std::setw(10) << r.loss
+        << std::setw(10) << std::setprecision(1) << r.seconds << std::defaultfloat << "\n";
+  }
+  out.flush();
+}
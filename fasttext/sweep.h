@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_SWEEP_H
+#define FASTTEXT_SWEEP_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "real.h"
+
+// The trials of a sweep. -lr, -lr_mono, -lr_par, -dim, -ws and -neg may be
+// given a list of values ("-lr 0.05,0.1,0.5") or a range ("-lr 0.01:1").
+// Without -trials every combination of the lists is one trial (grid
+// search). With -trials n, n combinations are drawn at random: a value of
+// each list, or a point of each range, log-uniform for the learning rates
+// and uniform for the others. Options given a single value are not swept.
+class Sweep {
+  private:
+    struct Axis {
+      std::string name;
+      std::vector<double> values;
+      double lo;
+      double hi;
+      bool range;
+    };
+    std::vector<Axis> axes_;
+    int32_t trials_;
+
+    static bool sweepable(const std::string&);
+
+  public:
+    struct Result {
+      int32_t trial;
+      std::vector<double> values;
+      real precision;
+      real loss;
+      double seconds;
+    };
+
+    // Takes the swept options and -trials out of the command line, so that
+    // Args can parse what is left.
+    explicit Sweep(std::vector<std::string>&);
+
+    std::vector<std::vector<double>> trials() const;
+    void apply(const std::vector<double>&, Args&) const;
+    void printTable(std::ostream&, std::vector<Result>) const;
+};
+
+#endif
@@ -9,60 +9,100 @@
 
 #include "utils.h"
 
-#include <cmath>
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
 #include <ios>
 
 namespace utils {
-  real* t_sigmoid = nullptr;
-  real* t_log = nullptr;
+  static_assert(sizeof(real) == sizeof(float), "the kernels work on floats");
+
+  static inline float asFloat(uint32_t i) {
+    float f;
+    memcpy(&f, &i, sizeof(float));
+    return f;
+  }
+
+  static inline uint32_t asBits(float f) {
+    uint32_t i;
+    memcpy(&i, &f, sizeof(float));
+    return i;
+  }
+
+  // exp(x) = 2^n exp(r) with n = round(x / ln 2) and |r| <= ln(2) / 2.
+  static inline float expPoly(float x) {
+    x = std::min(std::max(x, -87.0f), 88.0f);
+    float t = x * 1.44269504088896341f + 0.5f;
+    int32_t n = int32_t(t);
+    n -= float(n) > t;
+    float fn = float(n);
+    float r = x - fn * 0.693359375f + fn * 2.12194440e-4f;
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+    return p * asFloat(uint32_t(n + 127) << 23);
+  }
+
+  // log(x) = e ln 2 + log(m) with m in [sqrt(2) / 2, sqrt(2)).
+  static inline float logPoly(float x) {
+    x = std::max(x, float(LOG_MIN));
+    uint32_t bits = asBits(x);
+    float e = float(int32_t(bits >> 23) - 126);
+    float m = asFloat((bits & 0x007fffff) | 0x3f000000);
+    float small = m < 0.707106781186547524f ? 1.0f : 0.0f;
+    e -= small;
+    m = m - 1.0f + small * m;
+    float z = m * m;
+    float p = 7.0376836292e-2f;
+    p = p * m - 1.1514610310e-1f;
+    p = p * m + 1.1676998740e-1f;
+    p = p * m - 1.2420140846e-1f;
+    p = p * m + 1.4249322787e-1f;
+    p = p * m - 1.6668057665e-1f;
+    p = p * m + 2.0000714765e-1f;
+    p = p * m - 2.4999993993e-1f;
+    p = p * m + 3.3333331174e-1f;
+    float y = p * m * z - e * 2.12194440e-4f - 0.5f * z;
+    return m + y + e * 0.693359375f;
+  }
+
+  static inline float sigmoidPoly(float x) {
+    return 1.0f / (1.0f + expPoly(-x));
+  }
 
   real log(real x) {
-    if (x > 1.0) {
-      return 0.0;
-    }
-    int i = int(x * LOG_TABLE_SIZE);
-    return t_log[i];
+    return logPoly(x);
   }
 
-  real sigmoid(real x) {
-    if (x < -MAX_SIGMOID) {
-      return 0.0;
-    } else if (x > MAX_SIGMOID) {
-      return 1.0;
-    } else {
-      int i = int((x + MAX_SIGMOID) * SIGMOID_TABLE_SIZE / MAX_SIGMOID / 2);
-      return t_sigmoid[i];
-    }
+  real exp(real x) {
+    return expPoly(x);
   }
 
-  void initTables() {
-    initSigmoid();
-    initLog();
+  real sigmoid(real x) {
+    return sigmoidPoly(x);
   }
 
-  void initSigmoid() {
-    if (t_sigmoid != nullptr) return;
-    t_sigmoid = new real[SIGMOID_TABLE_SIZE + 1];
-    for (int i = 0; i < SIGMOID_TABLE_SIZE + 1; i++) {
-      real x = real(i * 2 * MAX_SIGMOID) / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
-      t_sigmoid[i] = 1.0 / (1.0 + std::exp(-x));
+  void log_n(const real* x, real* y, int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+      y[i] = logPoly(x[i]);
     }
   }
 
-  void initLog() {
-    if (t_log != nullptr) return;
-    t_log = new real[LOG_TABLE_SIZE + 1];
-    for (int i = 0; i < LOG_TABLE_SIZE + 1; i++) {
-      real x = (real(i) + 1e-5) / LOG_TABLE_SIZE;
-      t_log[i] = std::log(x);
+  void exp_n(const real* x, real* y, int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+      y[i] = expPoly(x[i]);
     }
   }
 
-  void freeTables() {
-    delete[] t_sigmoid;
-    delete[] t_log;
-    t_sigmoid = nullptr;
-    t_log = nullptr;
+  void sigmoid_n(const real* x, real* y, int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+      y[i] = sigmoidPoly(x[i]);
+    }
   }
 
   int64_t size(std::ifstream& ifs) {
@@ -14,19 +14,22 @@
 
 #include "real.h"
 
-#define SIGMOID_TABLE_SIZE 512
-#define MAX_SIGMOID 8
-#define LOG_TABLE_SIZE 512
+#define LOG_MIN 1e-8
 
 namespace utils {
 
+  // Polynomial approximations in the style of Cephes' expf/logf, written
+  // branch-free so that the _n loops vectorize. exp has a relative error
+  // below 2e-7 over [-87, 88] and clamps outside it; log has an absolute
+  // error below 1e-7 and clamps its input to at least LOG_MIN, so that a
+  // probability of 0 costs a finite loss.
   real log(real);
+  real exp(real);
   real sigmoid(real);
 
-  void initTables();
-  void initSigmoid();
-  void initLog();
-  void freeTables();
+  void log_n(const real*, real*, int64_t);
+  void exp_n(const real*, real*, int64_t);
+  void sigmoid_n(const real*, real*, int64_t);
 
   int64_t size(std::ifstream&);
   void seek(std::ifstream&, int64_t);
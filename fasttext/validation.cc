@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "validation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+Validation::Validation(std::shared_ptr<Args> args, std::shared_ptr<Dictionary> dict,
+                       std::shared_ptr<Matrix> input, std::shared_ptr<Matrix> output,
+                       std::shared_ptr<Metrics> metrics) {
+  args_ = args;
+  dict_ = dict;
+  metrics_ = metrics;
+  running_ = false;
+  best_ = -1.0;
+  sinceBest_ = 0;
+  corpus_ = std::make_shared<Corpus>(dict, args->valid);
+  // Predicting only needs the shared matrices: no per-thread rows to merge
+  // and no mini-batch engine.
+  std::shared_ptr<Args> margs = std::make_shared<Args>(*args);
+  margs->hotRows = 0;
+  margs->batch = 0;
+  model_ = std::make_shared<Model>(input, output, margs, 0);
+  model_->setTargetCounts(dict->getCounts(entry_type::label), dict);
+}
+
+Validation::~Validation() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  evaluator_.join();
+}
+
+// P@k on a tokenized held-out set, as FastText::test computes it.
+real Validation::precision(Model& model, Dictionary& dict, const Corpus& corpus,
+                           const Args& args, int32_t k) {
+  int64_t nexamples = 0;
+  double precision = 0.0;
+  std::vector<int32_t> line, labels;
+  Corpus::Cursor cursor{0, 0};
+  for (int64_t i = 0; i < corpus.nlines(); i++) {
+    corpus.getLine(cursor, dict, line, labels, args.model, 0.0);
+    dict.addNgrams(line, args.wordNgrams);
+    if (labels.size() > 0 && line.size() > 0) {
+      std::vector<std::pair<real, int32_t>> predictions;
+      model.predict(line, k, predictions);
+      for (auto it = predictions.cbegin(); it != predictions.cend(); it++) {
+        if (std::find(labels.begin(), labels.end(), it->second) != labels.end()) {
+          precision += 1.0;
+        }
+      }
+      nexamples++;
+    }
+  }
+  return nexamples > 0 ? precision / (k * nexamples) : 0.0;
+}
+
+void Validation::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) return;
+  running_ = true;
+  evaluator_ = std::thread([this]() { run(); });
+}
+
+void Validation::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  evaluator_.join();
+  evaluate(true);
+}
+
+double Validation::lrScale() const {
+  return lrScale_.load(std::memory_order_relaxed);
+}
+
+bool Validation::stopped() const {
+  return stopped_.load(std::memory_order_relaxed);
+}
+
+void Validation::run() {
+  auto interval = std::chrono::duration<double>(args_->validInterval);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    cv_.wait_for(lock, interval);
+    if (!running_ || stopped()) break;
+    lock.unlock();
+    evaluate(false);
+    lock.lock();
+  }
+}
+
+void Validation::evaluate(bool final) {
+  real p1;
+  {
+    profile::Phase phase("validation");
+    p1 = precision(*model_, *dict_, *corpus_, *args_, 1);
+  }
+  if (p1 > best_) {
+    best_ = p1;
+    sinceBest_ = 0;
+  } else {
+    sinceBest_++;
+  }
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(1)
+       << "Validation at " << 100 * metrics_->progress() << "%"
+       << std::setprecision(3) << "  P@1: " << p1 << "  best: " << best_;
+  if (lrScale() != 1.0) {
+    line << std::defaultfloat << "  lr x" << lrScale();
+  }
+  if (!final && args_->patience > 0 && sinceBest_ >= args_->patience) {
+    sinceBest_ = 0;
+    if (args_->lrCut > 0) {
+      lrScale_.store(lrScale() * args_->lrCut, std::memory_order_relaxed);
+      line << std::defaultfloat << "  (no improvement, lr x" << lrScale() << ")";
+    } else {
+      stopped_.store(true, std::memory_order_relaxed);
+      line << "  (no improvement, stopping)";
+    }
+  }
+  if (args_->verbose > 0) {
+    std::cerr << "\n" << line.str() << std::endl;
+  }
+}
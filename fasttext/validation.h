@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#ifndef FASTTEXT_VALIDATION_H
+#define FASTTEXT_VALIDATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "args.h"
+#include "corpus.h"
+#include "dictionary.h"
+#include "matrix.h"
+#include "metrics.h"
+#include "model.h"
+#include "real.h"
+
+// Scores a supervised task on held-out data (-valid) while it trains. Every
+// -validInterval seconds a background thread computes P@1 on a tokenized
+// copy of the data, with a Model of its own over the shared matrices: the
+// trainers are not paused and keep updating them meanwhile. After -patience
+// scores without a new best, the learning rate of every task is multiplied
+// by -lrCut, or training stops when -lrCut is 0.
+class Validation {
+  private:
+    std::shared_ptr<Args> args_;
+    std::shared_ptr<Dictionary> dict_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Corpus> corpus_;
+    std::shared_ptr<Model> model_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread evaluator_;
+    bool running_;
+    std::atomic<double> lrScale_{1.0};
+    std::atomic<bool> stopped_{false};
+    real best_;
+    int32_t sinceBest_;
+
+    void run();
+    void evaluate(bool);
+
+  public:
+    // args are those of the supervised task, output its label matrix.
+    Validation(std::shared_ptr<Args>, std::shared_ptr<Dictionary>, std::shared_ptr<Matrix>,
+               std::shared_ptr<Matrix>, std::shared_ptr<Metrics>);
+    ~Validation();
+
+    static real precision(Model&, Dictionary&, const Corpus&, const Args&, int32_t);
+
+    void start();
+    // Scores the final matrices once more.
+    void stop();
+    double lrScale() const;
+    bool stopped() const;
+};
+
+#endif
@@ -13,16 +13,17 @@
 
 #include <iomanip>
 
+#include "alloc.h"
 #include "matrix.h"
 #include "utils.h"
 
 Vector::Vector(int64_t m) {
   m_ = m;
-  data_ = new real[m];
+  data_ = (real*) alloc::allocate(m * sizeof(real));
 }
 
 Vector::~Vector() {
-  delete[] data_;
+  alloc::release(data_);
 }
 
 void Vector::zero() {
@@ -42,7 +43,7 @@ void Vector::addRow(const Matrix& A, int64_t i) {
   assert(i < A.m_);
   assert(m_ == A.n_);
   for (int64_t j = 0; j < A.n_; j++) {
-    data_[j] += A.data_[i * A.n_ + j];
+    data_[j] += A.data_[i * A.stride_ + j];
   }
 }
 
@@ -51,7 +52,7 @@ void Vector::addRow(const Matrix& A, int64_t i, real a) {
   assert(i < A.m_);
   assert(m_ == A.n_);
   for (int64_t j = 0; j < A.n_; j++) {
-    data_[j] += a * A.data_[i * A.n_ + j];
+    data_[j] += a * A.data_[i * A.stride_ + j];
   }
 }
 
@@ -61,7 +62,7 @@ void Vector::mul(const Matrix& A, const Vector& vec) {
   for (int64_t i = 0; i < m_; i++) {
     data_[i] = 0.0;
     for (int64_t j = 0; j < A.n_; j++) {
-      data_[i] += A.data_[i * A.n_ + j] * vec.data_[j];
+      data_[i] += A.data_[i * A.stride_ + j] * vec.data_[j];
     }
   }
 }
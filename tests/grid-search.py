@@ -5,6 +5,13 @@ import subprocess
 res = []
 lrs = [2 ** -e for e in range(1, 7)]
 
+# Count the vocabulary once; every trial below loads it with -dict.
+dict_cmd = ("fasttext build-dict "
+    "-input s-5000.txt "
+    "-output ./models/dev "
+    "-dim 10")
+subprocess.call(dict_cmd.split())
+
 for lr in lrs:
     for lr_wv in lrs:
         print (lr, lr_wv)
@@ -13,6 +20,7 @@ for lr in lrs:
             "-input-par1 s-100-u.txt "
             "-input-par2 t-100-u.txt "
             "-output ./models/dev "
+            "-dict ./models/dev.dict "
             "-dim 10 -lr %f -lr_wv %f") % (lr, lr_wv)
         
         test_source_cmd = 'fasttext test ./models/dev-sup.bin ./s-5000-2.txt'
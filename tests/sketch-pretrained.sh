@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Continued training (-pretrained) counts the vocabulary of the new corpora
+# the same way with and without -sketch: the sketch estimates of pass 1 must
+# not stay on the pretrained entries.
+#
+#   FT=./ft tests/sketch-pretrained.sh
+
+set -e
+FT=${FT:-./ft}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+python3 "$(dirname "$0")/../bench/gen-corpus.py" --out-dir "$DIR" \
+    --tokens 100000 --par-lines 1000 --sup-lines 1000 > /dev/null
+head -n 200 "$DIR/mono-s.txt" > "$DIR/new-s.txt"
+
+INPUTS="-input $DIR/sup.txt -input-mono1 $DIR/mono-s.txt -input-mono2 $DIR/mono-t.txt
+        -input-par1 $DIR/par-s.txt -input-par2 $DIR/par-t.txt"
+NEW="-input $DIR/sup.txt -input-mono1 $DIR/new-s.txt -input-mono2 $DIR/mono-t.txt
+     -input-par1 $DIR/par-s.txt -input-par2 $DIR/par-t.txt"
+OPTS="-dim 8 -epoch 1 -thread 1"
+
+echo '- training -'
+$FT bilingual-s $INPUTS $OPTS -output "$DIR/old" > /dev/null 2>&1
+echo '- continuing, exact counts -'
+$FT bilingual-s $NEW $OPTS -pretrained "$DIR/old-no-thread.bin" -output "$DIR/exact" > /dev/null 2>&1
+echo '- continuing, sketched counts -'
+$FT bilingual-s $NEW $OPTS -pretrained "$DIR/old-no-thread.bin" -sketch 1 -output "$DIR/sketch" > /dev/null 2>&1
+
+# Word counts of the dictionary in a model file: magic, version, the 56
+# bytes of Args, then size, nwords, nlabels, ntokens and the entries.
+python3 - "$DIR/old-no-thread.bin" "$DIR/exact-no-thread.bin" "$DIR/sketch-no-thread.bin" <<'EOF'
+import struct, sys
+
+def counts(path):
+    data = open(path, 'rb').read()
+    size, = struct.unpack_from('<i', data, 64)
+    off = 64 + 4 + 4 + 4 + 8
+    result = {}
+    for _ in range(size):
+        end = data.index(b'\0', off)
+        word = data[off:end].decode()
+        count, = struct.unpack_from('<q', data, end + 1)
+        result[word] = count
+        off = end + 1 + 8 + 1
+    return result
+
+old, exact, sketch = (counts(p) for p in sys.argv[1:])
+bad = [w for w in old if exact.get(w) != sketch.get(w)]
+if bad:
+    w = bad[0]
+    print('FAIL: %d old words differ, e.g. %s: exact %s, sketch %s'
+          % (len(bad), w, exact.get(w), sketch.get(w)))
+    sys.exit(1)
+print('OK: %d old words counted alike' % len(old))
+EOF